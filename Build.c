@@ -232,7 +232,8 @@ int Build(char *mddev, struct mddev_dev *devlist,
 				}
 				bitmapsize = s->size>>9; /* FIXME wrong for RAID10 */
 				if (CreateBitmap(s->bitmap_file, 1, NULL, s->bitmap_chunk,
-						 c->delay, s->write_behind, bitmapsize, major)) {
+						 c->delay, s->write_behind, bitmapsize,
+						 major, 0)) {
 					goto abort;
 				}
 				bitmap_fd = open(s->bitmap_file, O_RDWR);
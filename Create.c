@@ -61,6 +61,124 @@ static int default_layout(struct supertype *st, int level, int verbose)
 	return layout;
 }
 
+/*
+ * --write-zeroes zeroes the data area of every member before the array
+ * is started, so that parity and mirror copies are correct without an
+ * initial resync.  We only allow it when the device can do this itself
+ * (WRITE ZEROES, or discard that reads back zeros), as otherwise
+ * BLKZEROOUT falls back to writing every block which is no faster
+ * than the resync it replaces.
+ */
+static int write_zeroes_supported(dev_t rdev)
+{
+	char path[80];
+	char buf[1024];
+
+	sprintf(path, "/sys/dev/block/%d:%d/queue/write_zeroes_max_bytes",
+		major(rdev), minor(rdev));
+	if (load_sys(path, buf) < 0) {
+		/* a partition uses the queue of its disk */
+		sprintf(path, "/sys/dev/block/%d:%d/../queue/write_zeroes_max_bytes",
+			major(rdev), minor(rdev));
+		if (load_sys(path, buf) < 0)
+			return 0;
+	}
+	return strtoull(buf, NULL, 10) > 0;
+}
+
+/*
+ * The kernel knows the data offset it chose for each member once the
+ * devices have been added, so read it from sysfs and zero the members
+ * from child processes, at most ZERO_JOBS at once, so that they
+ * proceed together.
+ */
+#define ZERO_JOBS 16
+
+struct zero_jobs {
+	struct mdinfo *sra;
+	struct mdinfo **devs;
+};
+
+static int zero_member(void *arg, int i)
+{
+	struct zero_jobs *jobs = arg;
+	struct mdinfo *dev = jobs->devs[i];
+	char devnum[24];
+	__u64 range[2];
+	int fd;
+
+	sprintf(devnum, "%d:%d", dev->disk.major, dev->disk.minor);
+	fd = dev_open(devnum, O_RDWR);
+	range[0] = dev->data_offset << 9;
+	range[1] = jobs->sra->component_size << 9;
+	if (fd < 0 || ioctl(fd, BLKZEROOUT, range) != 0) {
+		pr_err("failed to zero %s: %s\n",
+		       map_dev(dev->disk.major, dev->disk.minor, 1),
+		       strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return 1;
+	}
+	fsync(fd);
+	close(fd);
+	return 0;
+}
+
+static int zero_members(int mdfd, int verbose)
+{
+	struct mdinfo *sra = sysfs_read(mdfd, NULL,
+					GET_DEVS|GET_OFFSET|GET_COMPONENT);
+	struct zero_jobs jobs;
+	struct mdinfo *dev;
+	int *rvs;
+	int cnt = 0;
+	int rv = 0;
+	int i;
+
+	if (!sra) {
+		pr_err("cannot find data offsets for --write-zeroes\n");
+		return 1;
+	}
+	for (dev = sra->devs; dev; dev = dev->next)
+		cnt++;
+	jobs.sra = sra;
+	jobs.devs = xcalloc(cnt ? cnt : 1, sizeof(jobs.devs[0]));
+	rvs = xcalloc(cnt ? cnt : 1, sizeof(rvs[0]));
+	for (i = 0, dev = sra->devs; dev; dev = dev->next, i++) {
+		jobs.devs[i] = dev;
+		if (verbose > 0)
+			pr_err("zeroing %lluK at offset %lluK on %s\n",
+			       sra->component_size / 2,
+			       dev->data_offset / 2,
+			       map_dev(dev->disk.major, dev->disk.minor, 1));
+	}
+
+	run_jobs(cnt, ZERO_JOBS, zero_member, &jobs, rvs);
+
+	for (i = 0; i < cnt; i++)
+		rv |= rvs[i];
+	free(jobs.devs);
+	free(rvs);
+	sysfs_free(sra);
+	return rv;
+}
+
+/* The superblocks, and any internal bitmap, were written saying that
+ * the array is in sync, which is only true once zeroing has finished.
+ * If it failed, erase them again so that the members cannot later be
+ * assembled without a resync.
+ */
+static void erase_members(struct mddev_dev *devlist)
+{
+	struct mddev_dev *dv;
+
+	for (dv = devlist; dv; dv = dv->next)
+		if (strcasecmp(dv->devname, "missing") != 0 &&
+		    Kill(dv->devname, NULL, 1, -1, 0) != 0)
+			pr_err("%s may still have a superblock, use --zero-superblock to remove it\n",
+			       dv->devname);
+}
+
 int Create(struct supertype *st, char *mddev,
 	   char *name, int *uuid,
 	   int subdevs, struct mddev_dev *devlist,
@@ -327,6 +445,11 @@ int Create(struct supertype *st, char *mddev,
 			exit(2);
 		}
 		close(dfd);
+		if (s->write_zeroes && !write_zeroes_supported(stb.st_rdev)) {
+			pr_err("%s cannot offload zeroing, so --write-zeroes would be no faster than a resync\n",
+				dname);
+			exit(2);
+		}
 		info.array.working_disks++;
 		if (dnum < s->raiddisks)
 			info.array.active_disks++;
@@ -581,6 +704,12 @@ int Create(struct supertype *st, char *mddev,
 		return 1;
 	}
 
+	if (s->write_zeroes && (have_container || st->ss->external)) {
+		pr_err("--write-zeroes is not supported with %s metadata\n",
+		       st->ss->name);
+		return 1;
+	}
+
 	/* We need to create the device */
 	map_lock(&map);
 	mdfd = create_mddev(mddev, name, c->autof, LOCAL, chosen_name);
@@ -760,6 +889,8 @@ int Create(struct supertype *st, char *mddev,
 				st->ss->name);
 			goto abort_locked;
 		}
+		/* No chunk needs resyncing if we know it is in sync */
+		st->bitmap_clean = s->assume_clean;
 		if (!st->ss->add_internal_bitmap(st, &s->bitmap_chunk,
 						 c->delay, s->write_behind,
 						 bitmapsize, 1, major_num)) {
@@ -813,7 +944,7 @@ int Create(struct supertype *st, char *mddev,
 		if (CreateBitmap(s->bitmap_file, c->force, (char*)uuid, s->bitmap_chunk,
 				 c->delay, s->write_behind,
 				 bitmapsize,
-				 major_num)) {
+				 major_num, s->assume_clean)) {
 			goto abort_locked;
 		}
 		bitmap_fd = open(s->bitmap_file, O_RDWR);
@@ -967,6 +1098,13 @@ int Create(struct supertype *st, char *mddev,
 	map_unlock(&map);
 	free(infos);
 
+	if (s->write_zeroes && zero_members(mdfd, c->verbose)) {
+		pr_err("zeroing failed - not creating %s\n", mddev);
+		ioctl(mdfd, STOP_ARRAY, NULL);
+		erase_members(devlist);
+		goto abort;
+	}
+
 	if (s->level == LEVEL_CONTAINER) {
 		/* No need to start.  But we should signal udev to
 		 * create links */
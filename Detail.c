@@ -49,6 +49,51 @@ static int add_device(const char *dev, char ***p_devices,
 }
 
 int Detail(char *dev, struct context *c)
+{
+	int rv = __Detail(dev, c, NULL);
+
+	if (c->json)
+		printf("\n");
+	return rv;
+}
+
+/*
+ * When details of many arrays are wanted, the caller can pass in a
+ * detail_scan holding mdstat and map snapshots that are shared by all
+ * of them, rather than have them read again for each array.  The
+ * metadata of each container is kept there too, as loading it means
+ * reading every device in the container, and would otherwise be done
+ * again for each member array.
+ */
+static struct supertype *detail_container(struct detail_scan *ds,
+					  struct supertype *st)
+{
+	int i;
+
+	for (i = 0; i < ds->ncontainers; i++)
+		if (ds->containers[i]->ss == st->ss &&
+		    strcmp(ds->containers[i]->container_devnm,
+			   st->container_devnm) == 0)
+			return ds->containers[i];
+	return NULL;
+}
+
+void detail_scan_free(struct detail_scan *ds)
+{
+	int i;
+
+	for (i = 0; i < ds->ncontainers; i++) {
+		ds->containers[i]->ss->free_super(ds->containers[i]);
+		free(ds->containers[i]);
+	}
+	free(ds->containers);
+	ds->containers = NULL;
+	ds->ncontainers = 0;
+	map_free(ds->map);
+	ds->map = NULL;
+}
+
+int __Detail(char *dev, struct context *c, struct detail_scan *ds)
 {
 	/*
 	 * Print out details for an md array by using
@@ -84,6 +129,11 @@ int Detail(char *dev, struct context *c)
 	char *avail = NULL;
 	int external;
 	int inactive;
+	struct map_ent *map = NULL;
+	struct map_ent **mapp = ds ? &ds->map : &map;
+	struct mdstat_ent *mdstat = ds ? ds->mdstat : NULL;
+	struct supertype *cst = NULL;
+	int shared_st = 0;
 
 	if (fd < 0) {
 		pr_err("cannot open %s: %s\n",
@@ -136,12 +186,31 @@ int Detail(char *dev, struct context *c)
 		member = subarray;
 		container = map_dev_preferred(major(devid), minor(devid),
 					      1, c->prefer);
-		cfd = open_dev(st->container_devnm);
+		if (ds)
+			cst = detail_container(ds, st);
+		if (cst) {
+			info = cst->ss->container_content(cst,
+								  subarray);
+			if (info) {
+				strcpy(cst->devnm, st->devnm);
+				free(st);
+				st = cst;
+				shared_st = 1;
+			}
+		}
+		cfd = info ? -1 : open_dev(st->container_devnm);
 		if (cfd >= 0) {
 			err = st->ss->load_container(st, cfd, NULL);
 			close(cfd);
 			if (err == 0)
 				info = st->ss->container_content(st, subarray);
+			if (info && ds && !cst) {
+				ds->containers = xrealloc(ds->containers,
+					(ds->ncontainers + 1) *
+					sizeof(ds->containers[0]));
+				ds->containers[ds->ncontainers++] = st;
+				shared_st = 1;
+			}
 		}
 	}
 
@@ -222,56 +291,53 @@ int Detail(char *dev, struct context *c)
 	str = map_num(pers, array.level);
 
 	if (c->export) {
+		export_start(c->json, dev);
 		if (array.raid_disks) {
 			if (str)
-				printf("MD_LEVEL=%s\n", str);
-			printf("MD_DEVICES=%d\n", array.raid_disks);
+				export_value("MD_LEVEL", "%s", str);
+			export_value("MD_DEVICES", "%d", array.raid_disks);
 		} else {
 			if (!inactive)
-				printf("MD_LEVEL=container\n");
-			printf("MD_DEVICES=%d\n", array.nr_disks);
+				export_value("MD_LEVEL", "container");
+			export_value("MD_DEVICES", "%d", array.nr_disks);
 		}
 		if (container) {
-			printf("MD_CONTAINER=%s\n", container);
-			printf("MD_MEMBER=%s\n", member);
+			export_value("MD_CONTAINER", "%s", container);
+			export_value("MD_MEMBER", "%s", member);
 		} else {
 			if (sra && sra->array.major_version < 0)
-				printf("MD_METADATA=%s\n", sra->text_version);
+				export_value("MD_METADATA", "%s",
+					     sra->text_version);
 			else
-				printf("MD_METADATA=%d.%d\n",
-				       array.major_version, array.minor_version);
+				export_value("MD_METADATA", "%d.%d",
+					     array.major_version,
+					     array.minor_version);
 		}
 
 		if (st && st->sb && info) {
 			char nbuf[64];
-			struct map_ent *mp, *map = NULL;
+			struct map_ent *mp;
 
 			fname_from_uuid(st, info, nbuf, ':');
-			printf("MD_UUID=%s\n", nbuf+5);
-			mp = map_by_uuid(&map, info->uuid);
+			export_value("MD_UUID", "%s", nbuf+5);
+			mp = map_by_uuid(mapp, info->uuid);
 			if (mp && mp->path &&
-			    strncmp(mp->path, "/dev/md/", 8) == 0) {
-				printf("MD_DEVNAME=");
-				print_escape(mp->path+8);
-				putchar('\n');
-			}
+			    strncmp(mp->path, "/dev/md/", 8) == 0)
+				export_name("MD_DEVNAME", mp->path+8);
 
 			if (st->ss->export_detail_super)
 				st->ss->export_detail_super(st);
 		} else {
-			struct map_ent *mp, *map = NULL;
+			struct map_ent *mp;
 			char nbuf[64];
-			mp = map_by_devnm(&map, fd2devnm(fd));
+			mp = map_by_devnm(mapp, fd2devnm(fd));
 			if (mp) {
 				__fname_from_uuid(mp->uuid, 0, nbuf, ':');
-				printf("MD_UUID=%s\n", nbuf+5);
+				export_value("MD_UUID", "%s", nbuf+5);
 			}
 			if (mp && mp->path &&
-			    strncmp(mp->path, "/dev/md/", 8) == 0) {
-				printf("MD_DEVNAME=");
-				print_escape(mp->path+8);
-				putchar('\n');
-			}
+			    strncmp(mp->path, "/dev/md/", 8) == 0)
+				export_name("MD_DEVNAME", mp->path+8);
 		}
 		if (sra) {
 			struct mdinfo *mdi;
@@ -279,19 +345,22 @@ int Detail(char *dev, struct context *c)
 				char *path =
 					map_dev(mdi->disk.major,
 						mdi->disk.minor, 0);
+				char key[64];
 
+				snprintf(key, sizeof(key), "MD_DEVICE_%s_ROLE",
+					 mdi->sys_name+4);
 				if (mdi->disk.raid_disk >= 0)
-					printf("MD_DEVICE_%s_ROLE=%d\n",
-					       mdi->sys_name+4,
-					       mdi->disk.raid_disk);
+					export_value(key, "%d",
+						     mdi->disk.raid_disk);
 				else
-					printf("MD_DEVICE_%s_ROLE=spare\n",
-					       mdi->sys_name+4);
+					export_value(key, "spare");
+				snprintf(key, sizeof(key), "MD_DEVICE_%s_DEV",
+					 mdi->sys_name+4);
 				if (path)
-					printf("MD_DEVICE_%s_DEV=%s\n",
-					       mdi->sys_name+4, path);
+					export_value(key, "%s", path);
 			}
 		}
+		export_end();
 		goto out;
 	}
 
@@ -376,7 +445,7 @@ int Detail(char *dev, struct context *c)
 	} else {
 		mdu_bitmap_file_t bmf;
 		unsigned long long larray_size;
-		struct mdstat_ent *ms = mdstat_read(0, 0);
+		struct mdstat_ent *ms = mdstat ? mdstat : mdstat_read(0, 0);
 		struct mdstat_ent *e;
 		char *devnm;
 
@@ -515,7 +584,8 @@ int Detail(char *dev, struct context *c)
 			printf(" %7s Status : %d%% complete\n", sync_action[e->resync], e->percent);
 			is_rebuilding = 1;
 		}
-		free_mdstat(ms);
+		if (ms != mdstat)
+			free_mdstat(ms);
 
 		if ((st && st->sb) && (info && info->reshape_active)) {
 #if 0
@@ -688,7 +758,7 @@ This is pretty boring
 	if (spares && c->brief && array.raid_disks) printf(" spares=%d", spares);
 	if (c->brief && st && st->sb)
 		st->ss->brief_detail_super(st);
-	if (st)
+	if (st && !shared_st)
 		st->ss->free_super(st);
 
 	if (c->brief && c->verbose > 0 && devices) {
@@ -713,6 +783,7 @@ out:
 		free(devices[d]);
 	free(devices);
 	sysfs_free(sra);
+	map_free(map);
 	return rv;
 }
 
@@ -188,11 +188,61 @@ int Examine(struct mddev_dev *devlist,
 	return rv;
 }
 
-int ExamineBadblocks(char *devname, int brief, struct supertype *forcest)
+/* Binary export: a header of "MDBB", a version and a count, each
+ * little-endian 32bit, then a pair of little-endian 64bit sector and
+ * length for each entry.
+ */
+static int export_badblocks_binary(struct md_bb *bb)
+{
+	__u32 hdr[3];
+	__u64 *buf;
+	int i, len;
+
+	hdr[0] = __cpu_to_le32(MD_BB_MAGIC);
+	hdr[1] = __cpu_to_le32(1);
+	hdr[2] = __cpu_to_le32(bb->count);
+	len = bb->count * 2 * sizeof(buf[0]);
+	buf = xmalloc(len + 1);
+	for (i = 0; i < bb->count; i++) {
+		buf[i*2] = __cpu_to_le64(bb->entries[i].sector);
+		buf[i*2+1] = __cpu_to_le64(bb->entries[i].length);
+	}
+	fflush(stdout);
+	i = (write(1, hdr, sizeof(hdr)) != sizeof(hdr) ||
+	     write(1, buf, len) != len);
+	free(buf);
+	if (i)
+		pr_err("failed to write bad-blocks list: %s\n",
+		       strerror(errno));
+	return i;
+}
+
+static void export_badblocks_json(char *devname, struct md_bb *bb)
+{
+	int i;
+
+	printf("{\"device\": \"");
+	for (i = 0; devname[i]; i++)
+		if (devname[i] == '"' || devname[i] == '\\')
+			printf("\\%c", devname[i]);
+		else
+			putchar(devname[i]);
+	printf("\", \"badblocks\": [");
+	for (i = 0; i < bb->count; i++)
+		printf("%s\n  {\"sector\": %llu, \"length\": %llu}",
+		       i ? "," : "",
+		       bb->entries[i].sector, bb->entries[i].length);
+	printf("%s]}\n", bb->count ? "\n" : "");
+}
+
+int ExamineBadblocks(char *devname, int brief, int format,
+		     struct supertype *forcest)
 {
 	int fd = dev_open(devname, O_RDONLY);
 	struct supertype *st = forcest;
+	struct md_bb bb = { 0 };
 	int err = 1;
+	int i;
 
 	if (fd < 0) {
 		pr_err("cannot open %s: %s\n", devname, strerror(errno));
@@ -205,16 +255,43 @@ int ExamineBadblocks(char *devname, int brief, struct supertype *forcest)
 			pr_err("No md superblock detected on %s\n", devname);
 		goto out;
 	}
-	if (!st->ss->examine_badblocks) {
+	if (!st->ss->get_bad_blocks) {
 		pr_err("%s metadata does not support badblocks\n", st->ss->name);
 		goto out;
 	}
 	err = st->ss->load_super(st, fd, brief ? NULL : devname);
 	if (err)
 		goto out;
-	err = st->ss->examine_badblocks(st, fd, devname);
+	err = st->ss->get_bad_blocks(st, fd, &bb);
+	if (err == 2) {
+		err = 0;
+		if (format == BB_TEXT) {
+			printf("No bad-blocks list configured on %s\n", devname);
+			goto out;
+		}
+	} else if (err)
+		goto out;
+
+	switch (format) {
+	case BB_JSON:
+		export_badblocks_json(devname, &bb);
+		break;
+	case BB_BINARY:
+		err = export_badblocks_binary(&bb);
+		break;
+	default:
+		if (bb.count == 0) {
+			printf("Bad-blocks list is empty in %s\n", devname);
+			break;
+		}
+		printf("Bad-blocks on %s:\n", devname);
+		for (i = 0; i < bb.count; i++)
+			printf("%20llu for %llu sectors\n",
+			       bb.entries[i].sector, bb.entries[i].length);
+	}
 
 out:
+	md_bb_free(&bb);
 	if (fd >= 0)
 		close(fd);
 	if (st) {
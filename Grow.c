@@ -470,7 +470,8 @@ int Grow_addbitmap(char *devname, int fd, struct context *c, struct shape *s)
 			return 1;
 		}
 		if (CreateBitmap(s->bitmap_file, c->force, (char*)uuid, s->bitmap_chunk,
-				 c->delay, s->write_behind, bitmapsize, major)) {
+				 c->delay, s->write_behind, bitmapsize,
+				 major, 0)) {
 			return 1;
 		}
 		bitmap_fd = open(s->bitmap_file, O_RDWR);
@@ -4276,10 +4277,14 @@ int child_monitor(int afd, struct mdinfo *sra, struct reshape *reshape,
 		}
 
 		reshape_completed = sra->reshape_progress;
+		tracepoint(reshape_wait_start, sra->sys_name,
+			   backup_point, wait_point, suspend_point);
 		rv = progress_reshape(sra, reshape,
 				      backup_point, wait_point,
 				      &suspend_point, &reshape_completed,
 				      &frozen);
+		tracepoint(reshape_wait_done, sra->sys_name, rv,
+			   reshape_completed, suspend_point);
 		/* external metadata would need to ping_monitor here */
 		sra->reshape_progress = reshape_completed;
 
@@ -4352,12 +4357,16 @@ int child_monitor(int afd, struct mdinfo *sra, struct reshape *reshape,
 			}
 			if (actual_stripes == 0)
 				break;
+			tracepoint(reshape_backup_start, sra->sys_name,
+				   offset, actual_stripes, part);
 			grow_backup(sra, offset, actual_stripes,
 				    fds, offsets,
 				    disks, chunk, level, layout,
 				    dests, destfd, destoffsets,
 				    part, &degraded, buf);
 			validate(afd, destfd[0], destoffsets[0]);
+			tracepoint(reshape_backup_done, sra->sys_name,
+				   offset, actual_stripes, part);
 			/* record where 'part' is up to */
 			part = !part;
 			if (increasing)
@@ -32,6 +32,10 @@
 #include	<sys/wait.h>
 #include	<dirent.h>
 #include	<ctype.h>
+#include	<poll.h>
+#include	<signal.h>
+#include	<sys/socket.h>
+#include	<sys/un.h>
 
 static int count_active(struct supertype *st, struct mdinfo *sra,
 			int mdfd, char **availp,
@@ -1785,3 +1789,278 @@ int IncrementalRemove(char *devname, char *id_path, int verbose)
 	free_mdstat(ent);
 	return rv;
 }
+
+/*
+ * Incremental daemon.
+ *
+ * When many devices appear at once (e.g. a large enclosure at boot)
+ * udev would normally start one "mdadm --incremental" for each, and
+ * each of those must parse mdadm.conf, load policy, and then queue
+ * for the map lock.  "mdadm --incremental --daemon" instead listens on
+ * INCR_SOCK for device names sent by "mdadm --incremental --queue" and
+ * processes them in one long-lived process.  The config file and
+ * policy rules are loaded once, and again only when the config
+ * changes.  Devices which arrive close together are collected into a
+ * batch, duplicates being dropped, and then each is still handled by
+ * a full Incremental() call of its own.
+ *
+ * Each message is a datagram holding the sender's --run setting, its
+ * auto setting and require_homehost as "runstop autof require",
+ * then its homehost (empty for none), then the device name followed
+ * by any aliases, each nul terminated.  Options which cannot be
+ * passed this way (--config, --metadata) make the sender handle the
+ * device itself.
+ */
+#define INCR_BATCH_MS	100	/* wait this long for more devices */
+#define INCR_BATCH_MAX	256	/* but never collect more than this */
+#define INCR_MSG_MAX	4096
+
+static int incr_sigterm;
+static void incr_term(int sig)
+{
+	incr_sigterm = 1;
+}
+
+static void incr_sock_addr(struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_LOCAL;
+	strncpy(addr->sun_path, INCR_SOCK, sizeof(addr->sun_path) - 1);
+}
+
+/*
+ * IncrementalQueue - pass a device (and its aliases) to a running
+ * incremental daemon.  Returns 0 if the daemon accepted it, or 1 if
+ * there is no daemon or it is too busy to take the device now, in
+ * which case the caller should fall back to running Incremental()
+ * directly.
+ */
+static int incr_msg_add(char *msg, int *len, char *str)
+{
+	int l = strlen(str) + 1;
+
+	if (*len + l > INCR_MSG_MAX)
+		return -1;
+	memcpy(msg + *len, str, l);
+	*len += l;
+	return 0;
+}
+
+int IncrementalQueue(struct mddev_dev *devlist, struct context *c)
+{
+	struct sockaddr_un addr;
+	char msg[INCR_MSG_MAX];
+	char opts[40];
+	char *devname = devlist->devname;
+	int len = 0;
+	int sfd;
+	int rv = 1;
+
+	snprintf(opts, sizeof(opts), "%d %d %d",
+		 c->runstop, c->autof, c->require_homehost);
+	if (incr_msg_add(msg, &len, opts) ||
+	    incr_msg_add(msg, &len, c->homehost ?: "") ||
+	    incr_msg_add(msg, &len, devname))
+		return 1;
+	/* Aliases which don't fit are left out */
+	for (devlist = devlist->next; devlist; devlist = devlist->next)
+		if (incr_msg_add(msg, &len, devlist->devname))
+			break;
+
+	sfd = socket(PF_LOCAL, SOCK_DGRAM, 0);
+	if (sfd < 0)
+		return 1;
+	incr_sock_addr(&addr);
+	/* If the daemon's queue is full, don't wait for it */
+	if (sendto(sfd, msg, len, MSG_DONTWAIT,
+		   (struct sockaddr *)&addr, sizeof(addr)) == len)
+		rv = 0;
+	else if (c->verbose > 0)
+		pr_err("cannot queue %s for incremental daemon: %s\n",
+		       devname, strerror(errno));
+	close(sfd);
+	return rv;
+}
+
+/* A device waiting to be handled, its aliases, and the options
+ * it was queued with.
+ */
+struct incr_queued {
+	struct incr_queued *next;
+	struct mddev_dev *devlist;
+	int runstop;
+	int autof;
+	int require_homehost;
+	char *homehost;
+};
+
+static void incr_free_queued(struct incr_queued *q)
+{
+	while (q->devlist) {
+		struct mddev_dev *t = q->devlist;
+		q->devlist = t->next;
+		free(t->devname);
+		free(t);
+	}
+	free(q->homehost);
+	free(q);
+}
+
+static struct incr_queued *incr_parse_msg(char *msg, int len)
+{
+	struct incr_queued *q;
+	struct mddev_dev **dvp;
+	char *p = msg;
+
+	msg[len] = 0;
+	q = xcalloc(1, sizeof(*q));
+	if (sscanf(p, "%d %d %d", &q->runstop, &q->autof,
+		   &q->require_homehost) != 3)
+		goto bad;
+	p += strlen(p) + 1;
+	if (p >= msg + len)
+		goto bad;
+	if (*p)
+		q->homehost = xstrdup(p);
+	p += strlen(p) + 1;
+	dvp = &q->devlist;
+	while (p < msg + len) {
+		struct mddev_dev *dv;
+		int l = strlen(p);
+
+		if (l == 0)
+			break;
+		dv = xcalloc(1, sizeof(*dv));
+		dv->devname = xstrdup(p);
+		*dvp = dv;
+		dvp = &dv->next;
+		p += l + 1;
+	}
+	if (q->devlist)
+		return q;
+bad:
+	incr_free_queued(q);
+	return NULL;
+}
+
+static int incr_receive(int sfd, struct incr_queued **batch, int *cnt)
+{
+	/* Add one queued device to the batch unless it is
+	 * already there.  Returns -1 if nothing could be read.
+	 */
+	char msg[INCR_MSG_MAX + 1];
+	struct incr_queued **bp;
+	struct incr_queued *q;
+	int len;
+
+	len = recv(sfd, msg, INCR_MSG_MAX, MSG_DONTWAIT);
+	if (len <= 0)
+		return -1;
+	q = incr_parse_msg(msg, len);
+	if (!q)
+		return 0;
+	for (bp = batch; *bp; bp = &(*bp)->next)
+		if (strcmp((*bp)->devlist->devname, q->devlist->devname) == 0)
+			break;
+	if (*bp) {
+		/* Same device again, probably "add" then "change" */
+		incr_free_queued(q);
+		return 0;
+	}
+	*bp = q;
+	(*cnt)++;
+	return 0;
+}
+
+int IncrementalDaemon(struct context *c, struct supertype *st)
+{
+	struct sockaddr_un addr;
+	struct sigaction act;
+	struct pollfd pfd;
+	mode_t mask;
+	int sfd;
+	int rv;
+
+	/* Load mdadm.conf and policy now, they are then shared by
+	 * every device we are asked to handle until they change.
+	 */
+	conf_get_create_info();
+
+	(void)mkdir(MAP_DIR, 0755);
+	sfd = socket(PF_LOCAL, SOCK_DGRAM, 0);
+	if (sfd < 0) {
+		pr_err("cannot create socket: %s\n", strerror(errno));
+		return 1;
+	}
+	incr_sock_addr(&addr);
+	unlink(addr.sun_path);
+	mask = umask(077); /* ensure no world write access */
+	rv = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (rv < 0) {
+		pr_err("cannot bind to %s: %s\n", addr.sun_path,
+		       strerror(errno));
+		close(sfd);
+		return 1;
+	}
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = incr_term;
+	sigaction(SIGTERM, &act, NULL);
+	sigaction(SIGINT, &act, NULL);
+	act.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &act, NULL);
+
+	if (c->verbose > 0)
+		pr_err("incremental daemon listening on %s\n", addr.sun_path);
+
+	pfd.fd = sfd;
+	pfd.events = POLLIN;
+	while (!incr_sigterm) {
+		struct incr_queued *batch = NULL, *q;
+		int cnt = 0;
+
+		/* Wait for the first device ... */
+		if (poll(&pfd, 1, -1) <= 0)
+			continue;
+		if (incr_receive(sfd, &batch, &cnt) < 0)
+			continue;
+		/* ... then collect any others which arrive soon after */
+		while (cnt < INCR_BATCH_MAX &&
+		       poll(&pfd, 1, INCR_BATCH_MS) > 0)
+			incr_receive(sfd, &batch, &cnt);
+
+		if (conf_changed()) {
+			if (c->verbose > 0)
+				pr_err("config changed, reloading\n");
+			conf_unload();
+			conf_get_create_info();
+		}
+		dprintf("processing batch of %d device%s\n",
+			cnt, cnt == 1 ? "" : "s");
+		while (batch) {
+			/* Incremental() may modify context and supertype,
+			 * so each device gets a fresh copy.
+			 */
+			struct context c2 = *c;
+			struct supertype *st2 = st ? dup_super(st) : NULL;
+
+			q = batch;
+			batch = q->next;
+			c2.export = 0;
+			c2.runstop = q->runstop;
+			c2.autof = q->autof;
+			c2.homehost = q->homehost;
+			c2.require_homehost = q->require_homehost;
+			Incremental(q->devlist, &c2, st2);
+			if (st2) {
+				st2->ss->free_super(st2);
+				free(st2);
+			}
+			incr_free_queued(q);
+		}
+	}
+	close(sfd);
+	unlink(addr.sun_path);
+	return 0;
+}
@@ -29,6 +29,73 @@
 #include	"md_u.h"
 #include	"md_p.h"
 
+/* One device being zeroed by Kill() or Kill_list() */
+struct kill_dev {
+	char *devname;
+	struct supertype *st;
+	int fd;
+	int found;	/* result of load_super */
+};
+
+/* Open the device and load whatever superblock is on it.
+ * Returns -1 if that superblock should now be zeroed by kill_store(),
+ * otherwise the result for Kill() to return.
+ */
+static int kill_load(struct kill_dev *kd, int force, int verbose, int noexcl)
+{
+	if (force)
+		noexcl = 1;
+	kd->fd = open(kd->devname, O_RDWR|(noexcl ? 0 : O_EXCL));
+	if (kd->fd < 0) {
+		if (verbose >= 0)
+			pr_err("Couldn't open %s for write - not zeroing\n",
+				kd->devname);
+		return 2;
+	}
+	if (kd->st == NULL)
+		kd->st = guess_super(kd->fd);
+	if (kd->st == NULL || kd->st->ss->init_super == NULL) {
+		if (verbose >= 0)
+			pr_err("Unrecognised md component device - %s\n",
+			       kd->devname);
+		close(kd->fd);
+		kd->fd = -1;
+		return 2;
+	}
+	kd->st->ignore_hw_compat = 1;
+	kd->found = kd->st->ss->load_super(kd->st, kd->fd, kd->devname);
+	if (kd->found == 0 || (force && kd->found >= 2))
+		return -1;
+	close(kd->fd);
+	kd->fd = -1;
+	return kd->found;
+}
+
+/* Write an empty superblock in place of the one kill_load() found.
+ * Returns non-zero on failure.
+ */
+static int kill_store(struct kill_dev *kd)
+{
+	struct supertype *st = kd->st;
+
+	st->ss->free_super(st);
+	st->ss->init_super(st, NULL, 0, "", NULL, NULL, INVALID_SECTORS);
+	return st->ss->store_super(st, kd->fd) != 0;
+}
+
+static int kill_report(struct kill_dev *kd, int failed, int verbose)
+{
+	if (failed) {
+		if (verbose >= 0)
+			pr_err("Could not zero superblock on %s\n",
+				kd->devname);
+		return 1;
+	}
+	if (kd->found && verbose >= 0)
+		pr_err("superblock zeroed anyway\n");
+	return 0;
+}
+
 int Kill(char *dev, struct supertype *st, int force, int verbose, int noexcl)
 {
 	/*
@@ -39,44 +106,122 @@ int Kill(char *dev, struct supertype *st, int force, int verbose, int noexcl)
 	 *  1 - failed to write the zero superblock
 	 *  2 - failed to open the device or find a superblock.
 	 */
+	struct kill_dev kd = { .devname = dev, .st = st, .fd = -1 };
+	int rv;
 
-	int fd, rv = 0;
-
-	if (force)
-		noexcl = 1;
-	fd = open(dev, O_RDWR|(noexcl ? 0 : O_EXCL));
-	if (fd < 0) {
-		if (verbose >= 0)
-			pr_err("Couldn't open %s for write - not zeroing\n",
-				dev);
-		return 2;
+	rv = kill_load(&kd, force, verbose, noexcl);
+	if (rv < 0) {
+		rv = kill_report(&kd, kill_store(&kd), verbose);
+		close(kd.fd);
 	}
-	if (st == NULL)
-		st = guess_super(fd);
-	if (st == NULL || st->ss->init_super == NULL) {
-		if (verbose >= 0)
-			pr_err("Unrecognised md component device - %s\n", dev);
-		close(fd);
-		return 2;
+	return rv;
+}
+
+/* Zeroing a superblock is a small synchronous write and a sync, so
+ * doing a long list of devices one at a time spends most of its time
+ * waiting.  Kill_list() takes the devices KILL_JOBS at a time, finds
+ * the superblock on each in order, writes the empty superblocks from
+ * child processes at once, and reports the results in device order.
+ */
+#define KILL_JOBS 16
+
+static int kill_job(void *arg, int i)
+{
+	struct kill_dev **todo = arg;
+
+	return kill_store(todo[i]);
+}
+
+/* Devices are opened O_EXCL, so the same device cannot be in a batch
+ * twice.
+ */
+static int kill_same_dev(struct stat *a, struct stat *b)
+{
+	if (S_ISBLK(a->st_mode) && S_ISBLK(b->st_mode))
+		return a->st_rdev == b->st_rdev;
+	return a->st_dev == b->st_dev && a->st_ino == b->st_ino;
+}
+
+/* Zero the superblocks on up to KILL_JOBS different devices.  Returns
+ * how many were taken from 'devs', with the result for each in 'rvs'.
+ */
+static int kill_batch(struct mddev_dev *devs, struct supertype *st,
+		      int force, int verbose, int *rvs)
+{
+	struct kill_dev kds[KILL_JOBS], *todo[KILL_JOBS];
+	struct stat stbs[KILL_JOBS];
+	int failed[KILL_JOBS];
+	struct mddev_dev *dv;
+	int cnt, ntodo, i, j;
+
+	for (cnt = 0, dv = devs; cnt < KILL_JOBS && dv &&
+		     dv->disposition == KillOpt; cnt++, dv = dv->next) {
+		if (stat(dv->devname, &stbs[cnt]) != 0) {
+			memset(&stbs[cnt], 0, sizeof(stbs[cnt]));
+			continue;
+		}
+		for (j = 0; j < cnt; j++)
+			if (stbs[j].st_nlink &&
+			    kill_same_dev(&stbs[j], &stbs[cnt]))
+				break;
+		if (j < cnt)
+			break;
 	}
-	st->ignore_hw_compat = 1;
-	rv = st->ss->load_super(st, fd, dev);
-	if (rv == 0 || (force && rv >= 2)) {
-		st->ss->free_super(st);
-		st->ss->init_super(st, NULL, 0, "", NULL, NULL,
-				   INVALID_SECTORS);
-		if (st->ss->store_super(st, fd)) {
-			if (verbose >= 0)
-				pr_err("Could not zero superblock on %s\n",
-					dev);
-			rv = 1;
-		} else if (rv) {
-			if (verbose >= 0)
-				pr_err("superblock zeroed anyway\n");
-			rv = 0;
+	for (i = 0; i < cnt; i++)
+		rvs[i] = 0;
+
+	do {
+		ntodo = 0;
+		for (i = 0, dv = devs; i < cnt; i++, dv = dv->next) {
+			if (rvs[i] != 0)
+				continue;
+			memset(&kds[i], 0, sizeof(kds[i]));
+			kds[i].devname = dv->devname;
+			kds[i].st = dup_super(st);
+			rvs[i] = kill_load(&kds[i], force, verbose, 0);
+			if (rvs[i] < 0)
+				todo[ntodo++] = &kds[i];
+		}
+
+		run_jobs(ntodo, KILL_JOBS, kill_job, todo, failed);
+
+		for (i = 0, j = 0; i < cnt; i++) {
+			if (rvs[i] < 0) {
+				rvs[i] = kill_report(&kds[i], failed[j++],
+						     verbose);
+				close(kds[i].fd);
+			}
+			if (kds[i].st) {
+				kds[i].st->ss->free_super(kds[i].st);
+				free(kds[i].st);
+				kds[i].st = NULL;
+			}
+		}
+		verbose = -1;
+	} while (!st && ntodo);
+	return cnt;
+}
+
+/* Zero the superblocks on the run of devices at the start of 'devlist'
+ * which have disposition KillOpt.  If 'st' is not given, devices are
+ * zeroed repeatedly until no superblock is found, as there may be
+ * several.  Returns the results of Kill() or'ed together.
+ */
+int Kill_list(struct mddev_dev *devlist, struct supertype *st,
+	      int force, int verbose)
+{
+	struct mddev_dev *dv = devlist;
+	int rvs[KILL_JOBS];
+	int rv = 0;
+	int cnt, i;
+
+	while (dv && dv->disposition == KillOpt) {
+		cnt = kill_batch(dv, st, force, verbose, rvs);
+		for (i = 0; i < cnt; i++) {
+			rv |= st ? rvs[i] : rvs[i] & ~2;
+			dv = dv->next;
 		}
 	}
-	close(fd);
 	return rv;
 }
 
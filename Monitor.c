@@ -1036,6 +1036,56 @@ int Wait(char *dev)
 static char *clean_states[] = {
 	"clear", "inactive", "readonly", "read-auto", "clean", NULL };
 
+/* print the statistics kept by the mdmon looking after 'dev', which
+ * is a container or a member array.
+ */
+int MonitorStats(char *dev, int verbose)
+{
+	int fd;
+	struct mdinfo *mdi;
+	char devnm[32];
+	char *container;
+	char *report;
+
+	fd = open(dev, O_RDONLY);
+	if (fd < 0) {
+		pr_err("Couldn't open %s: %s\n", dev, strerror(errno));
+		return 1;
+	}
+	strcpy(devnm, fd2devnm(fd));
+	mdi = sysfs_read(fd, devnm, GET_VERSION);
+	close(fd);
+	if (!mdi) {
+		pr_err("Failed to read sysfs attributes for %s\n", dev);
+		return 1;
+	}
+	if (is_subarray(mdi->text_version))
+		container = mdi->text_version;
+	else if (mdi->array.major_version == -1 &&
+		 mdi->array.minor_version == -2)
+		container = devnm;
+	else {
+		pr_err("%s does not have externally managed metadata\n", dev);
+		sysfs_free(mdi);
+		return 1;
+	}
+
+	report = mdmon_stats_report(container);
+	if (!report) {
+		pr_err("Cannot get statistics from mdmon for %s: %s\n",
+		       dev, errno == EPROTO ? "mdmon is too old"
+					    : strerror(errno));
+		sysfs_free(mdi);
+		return 1;
+	}
+	if (verbose > 0)
+		printf("%s:\n", dev);
+	fputs(report, stdout);
+	free(report);
+	sysfs_free(mdi);
+	return 0;
+}
+
 int WaitClean(char *dev, int sock, int verbose)
 {
 	int fd;
@@ -102,6 +102,10 @@ struct option long_options[] = {
     {"udev-rules", 2, 0, UdevRules},
     {"offroot", 0, 0, OffRootOpt},
     {"examine-badblocks", 0, 0, ExamineBB},
+    {"badblocks-format", 1, 0, BadblocksFormat},
+    {"check-dirty", 1, 0, CheckDirtyOpt},
+    {"bitmap-advise", 1, 0, BitmapAdviseOpt},
+    {"monitor-stats", 0, 0, MonitorStatsOpt},
 
     {"dump", 1, 0, Dump},
     {"restore", 1, 0, Restore},
@@ -131,6 +135,7 @@ struct option long_options[] = {
     {"size",	  1, 0, 'z'},
     {"auto",	  1, 0, Auto}, /* also for --assemble */
     {"assume-clean",0,0, AssumeClean },
+    {"write-zeroes",0,0, WriteZeroes },
     {"metadata",  1, 0, 'e'}, /* superblock format */
     {"bitmap",	  1, 0, Bitmap},
     {"bitmap-chunk", 1, 0, BitmapChunk},
@@ -171,7 +176,10 @@ struct option long_options[] = {
     /* For Detail/Examine */
     {"brief",	  0, 0, Brief},
     {"export",	  0, 0, 'Y'},
+    {"json",	  0, 0, JsonOpt},
     {"sparc2.2",  0, 0, Sparc22},
+    {"histogram", 2, 0, HistogramOpt},
+    {"dirty-extents", 0, 0, DirtyExtents},
     {"test",      0, 0, 't'},
     {"prefer",    1, 0, Prefer},
 
@@ -197,6 +205,8 @@ struct option long_options[] = {
     /* For Incremental */
     {"rebuild-map", 0, 0, RebuildMapOpt},
     {"path", 1, 0, IncrementalPath},
+    {"daemon", 0, 0, DaemonOpt},
+    {"queue", 0, 0, QueueOpt},
 
     {0, 0, 0, 0}
 };
@@ -255,6 +265,7 @@ char OptionHelp[] =
 "  --brief       -b   : Be less verbose, more brief\n"
 "  --export      -Y   : With --detail, --detail-platform or --examine use\n"
 "                       key=value format for easy import into environment\n"
+"  --json             : With --detail, give the --export values as JSON\n"
 "  --force       -f   : Override normal checks and be more forceful\n"
 "\n"
 "  --assemble    -A   : Assemble an array\n"
@@ -287,6 +298,8 @@ char OptionHelp[] =
 "  --force       -f   : Honour devices as listed on command line.  Don't\n"
 "                     : insert a missing drive for RAID5.\n"
 "  --assume-clean     : Assume the array is already in-sync. This is dangerous for RAID5.\n"
+"  --write-zeroes     : Zero the data area of all devices, then create the\n"
+"                     : array as in-sync.  Devices must support write-zeroes.\n"
 "  --bitmap-chunk=    : chunksize of bitmap in bitmap file (Kilobytes)\n"
 "  --delay=      -d   : seconds between bitmap updates\n"
 "  --write-behind=    : number of simultaneous write-behind requests to allow (requires bitmap)\n"
@@ -499,7 +512,12 @@ char Help_misc[] =
 "  --detail-platform  : Display hardware/firmware details\n"
 "  --examine     -E   : Examine superblock on an array component\n"
 "  --examine-bitmap -X: Display contents of a bitmap file\n"
+"  --histogram=       : with -X, also show dirty chunks per region of\n"
+"                       the array, in this many regions (default 16)\n"
+"  --dirty-extents    : with -X, list the dirty regions as start/length\n"
+"                       pairs of sectors, for --check-dirty or raid6check\n"
 "  --examine-badblocks: Display list of known bad blocks on device\n"
+"  --badblocks-format=: with --examine-badblocks: text, json or binary\n"
 "  --zero-superblock  : erase the MD superblock from a device.\n"
 "  --run         -R   : start a partially built array\n"
 "  --stop        -S   : deactivate array, releasing all resources\n"
@@ -508,6 +526,10 @@ char Help_misc[] =
 "  --test        -t   : exit status 0 if ok, 1 if degrade, 2 if dead, 4 if missing\n"
 "  --wait        -W   : wait for resync/rebuild/recovery to finish\n"
 "  --action=          : initiate or abort ('idle' or 'frozen') a 'check' or 'repair'.\n"
+"  --check-dirty=     : 'check' only the extents listed in the given file\n"
+"  --bitmap-advise=   : benchmark bitmap chunk sizes on a scratch device with\n"
+"                       a trace of writes, or 'random', and recommend one\n"
+"  --monitor-stats    : show mdmon's counters for a container or its arrays\n"
 ;
 
 char Help_monitor[] =
@@ -590,6 +612,11 @@ char Help_incr[] =
 "                   : required number of devices, but are not yet started.\n"
 "  --fail        -f : First fail (if needed) and then remove device from\n"
 "                   : any array that it is a member of.\n"
+"  --daemon         : Stay running and assemble devices passed with --queue,\n"
+"                   : collecting those which arrive together into batches.\n"
+"  --queue          : Pass device to a running --daemon instead of handling\n"
+"                   : it directly.  Falls back to normal handling if there is\n"
+"                   : no daemon.\n"
 ;
 
 char Help_config[] =
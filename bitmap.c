@@ -71,8 +71,22 @@ typedef struct bitmap_info_s {
 	bitmap_super_t sb;
 	unsigned long long total_bits;
 	unsigned long long dirty_bits;
+	/* optional histogram of dirty bits by array offset:
+	 * region i covers bits [i*region_bits, (i+1)*region_bits)
+	 */
+	int regions;
+	unsigned long long region_bits;
+	unsigned long long *region_dirty;
+	/* optional list of runs of dirty bits, in bits */
+	struct dirty_extent *extents;
+	int nextents, extents_space;
 } bitmap_info_t;
 
+/* The bitmap is read in pieces of this size.  It must be a multiple
+ * of 4096 as the fd might be O_DIRECT.
+ */
+#define BITMAP_READ_SIZE (1024*1024)
+
 /* count the dirty bits in the first num_bits of byte */
 inline int count_dirty_bits_byte(char byte, int num_bits)
 {
@@ -93,12 +107,64 @@ inline int count_dirty_bits_byte(char byte, int num_bits)
 	return num;
 }
 
-int count_dirty_bits(char *buf, int num_bits)
+/* Count the bits set in whole 64bit words.  Bit order within bytes
+ * doesn't matter for a count, so the words don't need byte-swapping.
+ */
+static int count_dirty_words(char *buf, int bytes)
+{
+	int i, num = 0;
+
+	for (i = 0; i + 8 <= bytes; i += 8) {
+		unsigned long long w;
+		memcpy(&w, buf + i, 8);
+		num += __builtin_popcountll(w);
+	}
+	return num;
+}
+
+/* On x86-64 the default target has no popcnt instruction, so
+ * __builtin_popcountll becomes a library call.  Build the same loop
+ * for popcnt too, and use it when the CPU has it.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("popcnt")))
+static int count_dirty_words_popcnt(char *buf, int bytes)
 {
 	int i, num = 0;
 
-	for (i = 0; i < num_bits / 8; i++)
-		num += count_dirty_bits_byte(buf[i], 8);
+	for (i = 0; i + 8 <= bytes; i += 8) {
+		unsigned long long w;
+		memcpy(&w, buf + i, 8);
+		num += __builtin_popcountll(w);
+	}
+	return num;
+}
+
+static int use_popcnt(void)
+{
+	static int use = -1;
+
+	if (use < 0) {
+		__builtin_cpu_init();
+		use = __builtin_cpu_supports("popcnt") != 0;
+	}
+	return use;
+}
+#endif
+
+int count_dirty_bits(char *buf, int num_bits)
+{
+	int i, num;
+	int bytes = num_bits / 8;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (use_popcnt())
+		num = count_dirty_words_popcnt(buf, bytes);
+	else
+#endif
+		num = count_dirty_words(buf, bytes);
+	for (i = bytes & ~7; i < bytes; i++)
+		num += __builtin_popcount((unsigned char)buf[i]);
 
 	if (num_bits % 8) /* not an even byte boundary */
 		num += count_dirty_bits_byte(buf[i], num_bits % 8);
@@ -106,6 +172,37 @@ int count_dirty_bits(char *buf, int num_bits)
 	return num;
 }
 
+/* count dirty bits in 'bytes' bytes starting at bit offset 'bit'
+ * (a multiple of 8), adding them to the histogram as well as
+ * returning the total.
+ */
+static unsigned long long count_dirty_regions(bitmap_info_t *info,
+					      char *buf, int num_bits,
+					      unsigned long long bit)
+{
+	unsigned long long num = 0;
+
+	if (!info->regions)
+		return count_dirty_bits(buf, num_bits);
+
+	while (num_bits > 0) {
+		unsigned long long r = bit / info->region_bits;
+		unsigned long long left = (r+1) * info->region_bits - bit;
+		int n = num_bits;
+		int d;
+
+		if ((unsigned long long)n > left)
+			n = left;
+		d = count_dirty_bits(buf, n);
+		info->region_dirty[r] += d;
+		num += d;
+		buf += n / 8;
+		bit += n;
+		num_bits -= n;
+	}
+	return num;
+}
+
 /* calculate the size of the bitmap given the array size and bitmap chunksize */
 unsigned long long bitmap_bits(unsigned long long array_size,
 				unsigned long chunksize)
@@ -121,7 +218,75 @@ unsigned long bitmap_sectors(struct bitmap_super_s *bsb)
 	return (bits + bits_per_sector - 1) / bits_per_sector;
 }
 
-bitmap_info_t *bitmap_fd_read(int fd, int brief)
+/* Add 'len' dirty bits from 'start', extending the last extent if
+ * they follow on from it.
+ */
+static void add_dirty_extent(bitmap_info_t *info, unsigned long long start,
+			     unsigned long long len)
+{
+	struct dirty_extent *e;
+
+	if (info->nextents) {
+		e = &info->extents[info->nextents - 1];
+		if (e->start + e->length == start) {
+			e->length += len;
+			return;
+		}
+	}
+	if (info->nextents == info->extents_space) {
+		info->extents_space = info->extents_space ?
+			info->extents_space * 2 : 64;
+		info->extents = xrealloc(info->extents,
+					 info->extents_space * sizeof(*e));
+	}
+	e = &info->extents[info->nextents++];
+	e->start = start;
+	e->length = len;
+}
+
+/* Record the runs of set bits in 'num_bits' bits of buf, which start
+ * at bit 'bit' of the bitmap (a multiple of 8).  A run which continues
+ * from the previous buffer is extended rather than started afresh.
+ */
+static void collect_dirty_extents(bitmap_info_t *info, unsigned char *buf,
+				  int num_bits, unsigned long long bit)
+{
+	int i;
+
+	for (i = 0; i < num_bits; ) {
+		unsigned long long w;
+		int j;
+
+		if ((i & 63) == 0 && i + 64 <= num_bits) {
+			memcpy(&w, buf + i/8, 8);
+			if (w == 0) {
+				i += 64;
+				continue;
+			}
+		}
+		if ((i & 7) == 0 && buf[i/8] == 0) {
+			i += 8;
+			continue;
+		}
+		if (!(buf[i/8] & (1 << (i & 7)))) {
+			i++;
+			continue;
+		}
+		for (j = i + 1; j < num_bits; j++) {
+			if ((j & 7) == 0 && j + 8 <= num_bits &&
+			    buf[j/8] == 0xff) {
+				j += 7;
+				continue;
+			}
+			if (!(buf[j/8] & (1 << (j & 7))))
+				break;
+		}
+		add_dirty_extent(info, bit + i, j - i);
+		i = j;
+	}
+}
+
+bitmap_info_t *bitmap_fd_read(int fd, int brief, int regions, int extents)
 {
 	/* Note: fd might be open O_DIRECT, so we must be
 	 * careful to align reads properly
@@ -131,13 +296,13 @@ bitmap_info_t *bitmap_fd_read(int fd, int brief)
 	void *buf;
 	unsigned int n, skip;
 
-	if (posix_memalign(&buf, 4096, 8192) != 0) {
-		pr_err("failed to allocate 8192 bytes\n");
+	if (posix_memalign(&buf, 4096, BITMAP_READ_SIZE) != 0) {
+		pr_err("failed to allocate %d bytes\n", BITMAP_READ_SIZE);
 		return NULL;
 	}
-	n = read(fd, buf, 8192);
+	n = read(fd, buf, BITMAP_READ_SIZE);
 
-	info = xmalloc(sizeof(*info));
+	info = xcalloc(1, sizeof(*info));
 
 	if (n < sizeof(info->sb)) {
 		pr_err("failed to read superblock of bitmap file: %s\n", strerror(errno));
@@ -162,11 +327,23 @@ bitmap_info_t *bitmap_fd_read(int fd, int brief)
 	 */
 	total_bits = bitmap_bits(info->sb.sync_size, info->sb.chunksize);
 
+	if (regions > 0) {
+		/* keep regions byte aligned so that each read buffer
+		 * splits cleanly between them.
+		 */
+		unsigned long long rb = (total_bits + regions - 1) / regions;
+		rb = (rb + 7) & ~7ULL;
+		info->region_bits = rb;
+		info->regions = (total_bits + rb - 1) / rb;
+		info->region_dirty = xcalloc(info->regions,
+					     sizeof(info->region_dirty[0]));
+	}
+
 	while(read_bits < total_bits) {
 		unsigned long long remaining = total_bits - read_bits;
 
 		if (n == 0) {
-			n = read(fd, buf, 8192);
+			n = read(fd, buf, BITMAP_READ_SIZE);
 			skip = 0;
 			if (n <= 0)
 				break;
@@ -174,7 +351,11 @@ bitmap_info_t *bitmap_fd_read(int fd, int brief)
 		if (remaining > (n-skip) * 8) /* we want the full buffer */
 			remaining = (n-skip) * 8;
 
-		dirty_bits += count_dirty_bits(buf+skip, remaining);
+		dirty_bits += count_dirty_regions(info, buf+skip, remaining,
+						  read_bits);
+		if (extents)
+			collect_dirty_extents(info, buf+skip, remaining,
+					      read_bits);
 
 		read_bits += remaining;
 		n = 0;
@@ -183,6 +364,12 @@ bitmap_info_t *bitmap_fd_read(int fd, int brief)
 	if (read_bits < total_bits) { /* file truncated... */
 		pr_err("WARNING: bitmap file is not large enough for array size %llu!\n\n",
 			(unsigned long long)info->sb.sync_size);
+		if (extents)
+			/* Nothing is known about the rest, so it
+			 * must all be treated as dirty.
+			 */
+			add_dirty_extent(info, read_bits,
+					 total_bits - read_bits);
 		total_bits = read_bits;
 	}
 out:
@@ -247,7 +434,42 @@ __u32 swapl(__u32 l)
 	c[2] = t;
 	return l;
 }
-int ExamineBitmap(char *filename, int brief, struct supertype *st)
+/* Report the dirty regions of the bitmap as a list of extents in
+ * sectors of the sync range (array offset for RAID1, device offset for
+ * RAID4/5/6) which read_dirty_extents() can read back.
+ */
+static int print_dirty_extents(char *filename, bitmap_info_t *info)
+{
+	bitmap_super_t *sb = &info->sb;
+	unsigned long long chunk_sectors = sb->chunksize >> 9;
+	int i;
+
+	if (sb->magic != BITMAP_MAGIC) {
+		pr_err("invalid bitmap magic 0x%x on %s\n",
+		       sb->magic, filename);
+		return 1;
+	}
+	if (sb->version < BITMAP_MAJOR_LO ||
+	    sb->version > BITMAP_MAJOR_HI) {
+		pr_err("unknown bitmap version %d on %s\n",
+		       sb->version, filename);
+		return 1;
+	}
+	printf("# dirty extents of %s: start length (sectors)\n", filename);
+	for (i = 0; i < info->nextents; i++) {
+		struct dirty_extent *e = &info->extents[i];
+		unsigned long long start = e->start * chunk_sectors;
+		unsigned long long end = (e->start + e->length) * chunk_sectors;
+
+		if (end > sb->sync_size)
+			end = sb->sync_size;
+		printf("%llu %llu\n", start, end - start);
+	}
+	return 0;
+}
+
+int ExamineBitmap(char *filename, int brief, int histogram, int extents,
+		  struct supertype *st)
 {
 	/*
 	 * Read the bitmap file and display its contents
@@ -265,10 +487,15 @@ int ExamineBitmap(char *filename, int brief, struct supertype *st)
 	if (fd < 0)
 		return rv;
 
-	info = bitmap_fd_read(fd, brief);
+	info = bitmap_fd_read(fd, brief && !extents, histogram, extents);
 	if (!info)
 		return rv;
 	sb = &info->sb;
+	if (extents) {
+		close(fd);
+		rv = print_dirty_extents(filename, info);
+		goto free_info;
+	}
 	if (sb->magic != BITMAP_MAGIC && md_get_version(fd) > 0) {
 		pr_err("This is an md array.  To view a bitmap you need to examine\n");
 		pr_err("a member device, not the array.\n");
@@ -332,34 +559,62 @@ int ExamineBitmap(char *filename, int brief, struct supertype *st)
 	printf("          Bitmap : %llu bits (chunks), %llu dirty (%2.1f%%)\n",
 			info->total_bits, info->dirty_bits,
 			100.0 * info->dirty_bits / (info->total_bits?:1));
+	if (info->regions) {
+		int i;
+		unsigned long long chunk_sectors = sb->chunksize >> 9;
+
+		printf("       Histogram : %d regions of %llu chunks,"
+		       " by start sector\n",
+		       info->regions, info->region_bits);
+		for (i = 0; i < info->regions; i++) {
+			unsigned long long start = i * info->region_bits;
+			unsigned long long bits = info->region_bits;
+
+			if (start >= info->total_bits)
+				break;
+			if (start + bits > info->total_bits)
+				bits = info->total_bits - start;
+			printf("  %14llu : %llu dirty (%2.1f%%)\n",
+			       start * chunk_sectors,
+			       info->region_dirty[i],
+			       100.0 * info->region_dirty[i] / bits);
+		}
+	}
 free_info:
+	free(info->extents);
+	free(info->region_dirty);
 	free(info);
 	return rv;
 }
 
+/* The bitmap is written in pieces of up to this size */
+#define BITMAP_WRITE_MAX (1024*1024)
+
 int CreateBitmap(char *filename, int force, char uuid[16],
 		 unsigned long chunksize, unsigned long daemon_sleep,
 		 unsigned long write_behind,
 		 unsigned long long array_size /* sectors */,
-		 int major)
+		 int major, int clean)
 {
 	/*
-	 * Create a bitmap file with a superblock and (optionally) a full bitmap
+	 * Create a bitmap file with a superblock and (optionally) a full bitmap.
+	 * If 'clean', the array is known to be in sync so no bits are set.
 	 */
 
-	FILE *fp;
+	int fd;
 	int rv = 1;
-	char block[512];
+	char *block;
 	bitmap_super_t sb;
-	long long bytes, filesize;
+	long long bytes;
+	int bsize;
 
 	if (!force && access(filename, F_OK) == 0) {
 		pr_err("bitmap file %s already exists, use --force to overwrite\n", filename);
 		return rv;
 	}
 
-	fp = fopen(filename, "w");
-	if (fp == NULL) {
+	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	if (fd < 0) {
 		pr_err("failed to open bitmap file %s: %s\n",
 			filename, strerror(errno));
 		return rv;
@@ -389,37 +644,37 @@ int CreateBitmap(char *filename, int force, char uuid[16],
 
 	sb_cpu_to_le(&sb); /* convert to on-disk byte ordering */
 
-	if (fwrite(&sb, sizeof(sb), 1, fp) != 1) {
-		pr_err("failed to write superblock to bitmap file %s: %s\n", filename, strerror(errno));
-		goto out;
-	}
-
-	/* calculate the size of the bitmap and write it to disk */
+	/* calculate the size of the bitmap and write it to disk.
+	 * The kernel cannot use a bitmap file with holes, so even a
+	 * clean bitmap is written out in full.
+	 */
 	bytes = (bitmap_bits(array_size, chunksize) + 7) / 8;
-	if (!bytes) {
-		rv = 0;
-		goto out;
-	}
-
-	filesize = bytes + sizeof(sb);
 
-	memset(block, 0xff, sizeof(block));
+	bsize = BITMAP_WRITE_MAX;
+	if (bytes + (long long)sizeof(sb) < bsize)
+		bsize = bytes + sizeof(sb);
+	block = xmalloc(bsize);
+	memset(block, clean ? 0 : 0xff, bsize);
+	memcpy(block, &sb, sizeof(sb));
+	bytes += sizeof(sb);
 
 	while (bytes > 0) {
-		if (fwrite(block, sizeof(block), 1, fp) != 1) {
-			pr_err("failed to write bitmap file %s: %s\n", filename, strerror(errno));
+		int n = bytes > bsize ? bsize : bytes;
+
+		n = write(fd, block, n);
+		if (n <= 0) {
+			pr_err("failed to write bitmap file %s: %s\n", filename,
+			       n < 0 ? strerror(errno) : "short write");
 			goto out;
 		}
-		bytes -= sizeof(block);
+		bytes -= n;
+		memset(block, clean ? 0 : 0xff, sizeof(sb));
 	}
 
 	rv = 0;
-	fflush(fp);
-	/* make the file be the right size (well, to the nearest byte) */
-	if (ftruncate(fileno(fp), filesize))
-		perror("ftrunace");
 out:
-	fclose(fp);
+	free(block);
+	close(fd);
 	if (rv)
 		unlink(filename); /* possibly corrupted, better get rid of it */
 	return rv;
@@ -444,3 +699,384 @@ int bitmap_update_uuid(int fd, int *uuid, int swap)
 	lseek(fd, 0, 0);
 	return 0;
 }
+
+/*
+ * Bitmap chunk size advisor.
+ *
+ * A write to a chunk whose bit is clear must wait for the bitmap to be
+ * updated on disk before the data can be written, while a bit is only
+ * cleared once its chunk has been idle for a couple of daemon periods.
+ * So a small chunk costs latency on scattered writes, and a large one
+ * costs resync time after an unclean shutdown.
+ *
+ * To advise on the trade-off we run a write workload - either a trace
+ * or a synthetic random-write profile - through a model of the bitmap
+ * for each candidate chunk size, giving the writes which need a bitmap
+ * update and the number of dirty chunks at each point.  The writes,
+ * plus the bitmap updates, are then replayed on a scratch device to
+ * measure the latency they add, and a large sequential read measures
+ * how quickly a resync could proceed.
+ */
+
+#define ADVISE_RANDOM_IOS	20000	/* synthetic profile: 4K writes */
+#define ADVISE_RANDOM_IOPS	1000	/* ... at this rate */
+#define ADVISE_SAMPLE		2000	/* writes actually replayed */
+#define ADVISE_MAX_IO		(1024*1024)
+#define ADVISE_READ_SIZE	(256*1024*1024ULL)
+#define ADVISE_RESYNC_TARGET	60	/* seconds */
+#define ADVISE_DATA_START	2048	/* sectors kept clear for the "bitmap" */
+
+struct advise_io {
+	double time;			/* seconds */
+	unsigned long long offset;	/* sectors */
+	unsigned long long length;	/* sectors */
+};
+
+struct advise_chunk {
+	unsigned long long chunk;
+	double last;
+	char used, dirty;
+};
+
+static int cmp_advise_io(const void *av, const void *bv)
+{
+	const struct advise_io *a = av, *b = bv;
+
+	if (a->time < b->time)
+		return -1;
+	return a->time > b->time;
+}
+
+/* Load a trace of "time offset length" lines (seconds and sectors),
+ * or generate the synthetic profile if trace is "random".
+ * Offsets are folded into the scratch device and aligned to 4K.
+ */
+static int advise_load(char *trace, unsigned long long sectors,
+		       struct advise_io **iop)
+{
+	struct advise_io *io = NULL;
+	unsigned long long space = sectors - ADVISE_DATA_START;
+	int cnt = 0, size = 0;
+	int i;
+
+	if (strcmp(trace, "random") == 0) {
+		unsigned int seed = 1;
+
+		io = xmalloc(ADVISE_RANDOM_IOS * sizeof(*io));
+		for (cnt = 0; cnt < ADVISE_RANDOM_IOS; cnt++) {
+			unsigned long long r = rand_r(&seed);
+
+			r = (r << 31) | rand_r(&seed);
+			io[cnt].time = (double)cnt / ADVISE_RANDOM_IOPS;
+			io[cnt].offset = r;
+			io[cnt].length = 8;
+		}
+	} else {
+		FILE *f = fopen(trace, "r");
+		char line[256];
+
+		if (!f) {
+			pr_err("cannot open %s: %s\n", trace, strerror(errno));
+			return -1;
+		}
+		while (fgets(line, sizeof(line), f)) {
+			double t;
+			unsigned long long o, l;
+
+			if (line[0] == '#' ||
+			    sscanf(line, "%lf %llu %llu", &t, &o, &l) != 3)
+				continue;
+			if (cnt == size) {
+				size = size ? size * 2 : 1024;
+				io = xrealloc(io, size * sizeof(*io));
+			}
+			io[cnt].time = t;
+			io[cnt].offset = o;
+			io[cnt].length = l;
+			cnt++;
+		}
+		fclose(f);
+		if (!cnt) {
+			pr_err("no writes found in %s\n", trace);
+			free(io);
+			return -1;
+		}
+		qsort(io, cnt, sizeof(*io), cmp_advise_io);
+	}
+	for (i = 0; i < cnt; i++) {
+		unsigned long long l = (io[i].length + 7) & ~7ULL;
+
+		if (l == 0)
+			l = 8;
+		if (l > ADVISE_MAX_IO / 512)
+			l = ADVISE_MAX_IO / 512;
+		io[i].length = l;
+		io[i].offset = ADVISE_DATA_START +
+			((io[i].offset % (space - l)) & ~7ULL);
+	}
+	*iop = io;
+	return cnt;
+}
+
+/* Run the writes through a model of the bitmap with the given chunk
+ * size.  need[i] is set if write i has to wait for a bitmap update.
+ * Returns the number of updates and the mean and largest number of
+ * dirty chunks seen when a write arrives.
+ */
+static unsigned long advise_model(struct advise_io *io, int cnt,
+				  unsigned long long chunk_sectors,
+				  char *need, double *mean_dirty,
+				  unsigned long *max_dirty)
+{
+	double clear = 2 * DEFAULT_BITMAP_DELAY;
+	struct advise_chunk *hash;
+	struct advise_chunk **fifo;
+	unsigned long touches = 0, hsize = 1, head = 0, tail = 0;
+	unsigned long dirty = 0, updates = 0;
+	double dirty_sum = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		touches += (io[i].offset + io[i].length - 1) / chunk_sectors
+			- io[i].offset / chunk_sectors + 1;
+	while (hsize < touches * 2)
+		hsize <<= 1;
+	hash = xcalloc(hsize, sizeof(*hash));
+	fifo = xmalloc(touches * sizeof(*fifo));
+	*max_dirty = 0;
+
+	for (i = 0; i < cnt; i++) {
+		unsigned long long c = io[i].offset / chunk_sectors;
+		unsigned long long last = (io[i].offset + io[i].length - 1)
+			/ chunk_sectors;
+
+		/* bits for chunks idle long enough have been cleared.
+		 * Only the most recent fifo entry for a chunk counts.
+		 */
+		while (head < tail && fifo[head]->last + clear <= io[i].time) {
+			struct advise_chunk *h = fifo[head++];
+			if (h->dirty && h->last + clear <= io[i].time) {
+				h->dirty = 0;
+				dirty--;
+			}
+		}
+		need[i] = 0;
+		for (; c <= last; c++) {
+			unsigned long hv = (c * 0x9E3779B97F4A7C15ULL) >> 20;
+			struct advise_chunk *h;
+
+			for (h = &hash[hv & (hsize-1)];
+			     h->used && h->chunk != c;
+			     h = &hash[++hv & (hsize-1)])
+				;
+			if (!h->used) {
+				h->used = 1;
+				h->chunk = c;
+			}
+			if (!h->dirty) {
+				h->dirty = 1;
+				dirty++;
+				need[i] = 1;
+			}
+			h->last = io[i].time;
+			fifo[tail++] = h;
+		}
+		if (need[i])
+			updates++;
+		dirty_sum += dirty;
+		if (dirty > *max_dirty)
+			*max_dirty = dirty;
+	}
+	*mean_dirty = dirty_sum / cnt;
+	free(fifo);
+	free(hash);
+	return updates;
+}
+
+static double advise_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Replay the first 'cnt' writes, preceding those flagged in need[]
+ * with a synchronous 4K "bitmap" write near the start of the device.
+ * Returns the elapsed time, or a negative number on error.
+ */
+static double advise_replay(int fd, int sfd, struct advise_io *io, int cnt,
+			    char *need, void *buf)
+{
+	double start = advise_now();
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		if (need && need[i] &&
+		    pwrite(sfd, buf, 4096, 8*512) != 4096)
+			return -1;
+		if (pwrite(fd, buf, io[i].length * 512, io[i].offset * 512)
+		    != (ssize_t)(io[i].length * 512))
+			return -1;
+	}
+	return advise_now() - start;
+}
+
+/* sequential read rate in bytes per second, limited by the
+ * md speed_limit_max as resync would be.
+ */
+static double advise_resync_rate(int fd, unsigned long long sectors,
+				 void *buf)
+{
+	unsigned long long bytes = sectors * 512 - ADVISE_DATA_START * 512;
+	unsigned long long done = 0;
+	double start, rate;
+	char limit[30];
+
+	if (bytes > ADVISE_READ_SIZE)
+		bytes = ADVISE_READ_SIZE;
+	start = advise_now();
+	while (done + ADVISE_MAX_IO <= bytes) {
+		if (pread(fd, buf, ADVISE_MAX_IO,
+			  ADVISE_DATA_START * 512 + done) != ADVISE_MAX_IO)
+			break;
+		done += ADVISE_MAX_IO;
+	}
+	if (!done)
+		return 0;
+	rate = done / (advise_now() - start);
+	if (load_sys("/proc/sys/dev/raid/speed_limit_max", limit) == 0 &&
+	    atoll(limit) > 0 && rate > atoll(limit) * 1024.0)
+		rate = atoll(limit) * 1024.0;
+	return rate;
+}
+
+/* chunk size as --bitmap-chunk would take it */
+static char *advise_chunk_str(unsigned long long bytes)
+{
+	static char buf[20];
+
+	if (bytes % (1024*1024) == 0)
+		snprintf(buf, sizeof(buf), "%lluM", bytes >> 20);
+	else
+		snprintf(buf, sizeof(buf), "%lluK", bytes >> 10);
+	return buf;
+}
+
+int BitmapAdvise(char *dev, char *trace, int force, int verbose)
+{
+	static const unsigned long long chunks[] = {
+		64*1024, 256*1024, 1024*1024, 4*1024*1024,
+		16*1024*1024, 64*1024*1024, 0 };
+	unsigned long long size, sectors;
+	struct advise_io *io = NULL;
+	char *need = NULL;
+	void *buf = NULL;
+	double base, rate;
+	int fd, sfd = -1;
+	int cnt, sample, i;
+	int best = -1;
+	unsigned long best_updates = 0;
+	int rv = 1;
+
+	fd = open(dev, O_RDWR|O_EXCL|O_DIRECT);
+	if (fd < 0) {
+		pr_err("cannot open %s: %s\n", dev, strerror(errno));
+		return 1;
+	}
+	if (!get_dev_size(fd, dev, &size))
+		goto out;
+	sectors = size >> 9;
+	/* there must be room beyond the largest write we replay */
+	if (sectors <= ADVISE_DATA_START + ADVISE_MAX_IO / 512) {
+		pr_err("%s is too small to benchmark\n", dev);
+		goto out;
+	}
+	sfd = open(dev, O_RDWR|O_DIRECT|O_SYNC);
+	if (sfd < 0) {
+		pr_err("cannot open %s: %s\n", dev, strerror(errno));
+		goto out;
+	}
+	if (!force) {
+		char msg[300];
+
+		snprintf(msg, sizeof(msg),
+			 "%s: benchmark will overwrite data on %s. Continue? ",
+			 Name, dev);
+		if (!ask(msg)) {
+			pr_err("%s not changed\n", dev);
+			goto out;
+		}
+	}
+
+	cnt = advise_load(trace, sectors, &io);
+	if (cnt <= 0)
+		goto out;
+	need = xmalloc(cnt);
+	if (posix_memalign(&buf, 4096, ADVISE_MAX_IO) != 0) {
+		pr_err("failed to allocate %d bytes\n", ADVISE_MAX_IO);
+		goto out;
+	}
+	memset(buf, 0, ADVISE_MAX_IO);
+	sample = cnt < ADVISE_SAMPLE ? cnt : ADVISE_SAMPLE;
+
+	rate = advise_resync_rate(fd, sectors, buf);
+	if (rate <= 0) {
+		pr_err("read from %s failed: %s\n", dev, strerror(errno));
+		goto out;
+	}
+	base = advise_replay(fd, sfd, io, sample, NULL, buf);
+	if (base < 0) {
+		pr_err("write to %s failed: %s\n", dev, strerror(errno));
+		goto out;
+	}
+
+	printf("Bitmap chunk advice for %s: %d writes over %.1f seconds\n",
+	       dev, cnt, io[cnt-1].time - io[0].time);
+	printf("  write latency %.0fus without bitmap, resync rate %.0fMB/s\n",
+	       base * 1000000 / sample, rate / 1000000);
+	printf("   Chunk  Bitmap writes   Added latency   Resync after crash\n");
+	printf("                            per write     expected     worst\n");
+	for (i = 0; chunks[i]; i++) {
+		unsigned long long cs = chunks[i];
+		unsigned long updates, max_dirty;
+		double mean_dirty, t, added, resync;
+
+		updates = advise_model(io, cnt, cs >> 9, need,
+				       &mean_dirty, &max_dirty);
+		t = advise_replay(fd, sfd, io, sample, need, buf);
+		if (t < 0) {
+			pr_err("write to %s failed: %s\n", dev, strerror(errno));
+			goto out;
+		}
+		added = (t - base) / sample;
+		if (added < 0)
+			added = 0;
+		resync = mean_dirty * cs / rate;
+		printf("%8s  %13lu  %7.0fus %5.1f%%  %9.1fs %8.1fs%s\n",
+		       advise_chunk_str(cs), updates,
+		       added * 1000000, 100 * added * sample / base,
+		       resync, max_dirty * cs / rate,
+		       cs == 64*1024*1024 ? "  (default)" : "");
+		if (resync <= ADVISE_RESYNC_TARGET &&
+		    (best < 0 || updates < best_updates)) {
+			best = i;
+			best_updates = updates;
+		}
+	}
+	if (best < 0)
+		best = 0;
+	printf("Recommended --bitmap-chunk=%s\n", advise_chunk_str(chunks[best]));
+	if (verbose > 0)
+		printf("  (fewest bitmap writes with an expected resync of at most %ds)\n",
+		       ADVISE_RESYNC_TARGET);
+	rv = 0;
+out:
+	free(buf);
+	free(need);
+	free(io);
+	if (sfd >= 0)
+		close(sfd);
+	close(fd);
+	return rv;
+}
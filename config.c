@@ -30,6 +30,7 @@
 #include	<ctype.h>
 #include	<pwd.h>
 #include	<grp.h>
+#include	<sys/mman.h>
 
 /*
  * Read the config file
@@ -115,17 +116,85 @@ struct conf_dev {
 	char *name;
 } *cdevlist = NULL;
 
-struct mddev_dev *load_partitions(void)
+/*
+ * conf_get_devs() may be asked for "partitions" and "containers" as
+ * well as any number of globs, and these can overlap.  Names are
+ * collected in a dev_table which hashes them so each device is listed,
+ * and later probed, only once, and which keeps a tail pointer so the
+ * list is built in linear time however many devices there are.
+ */
+#define DEV_TABLE_HASH 512
+struct dev_table {
+	struct mddev_dev *head, **tail;
+	struct dev_seen {
+		struct dev_seen *next;
+		struct mddev_dev *dv;
+	} *hash[DEV_TABLE_HASH];
+};
+
+static void dev_table_init(struct dev_table *dt)
+{
+	memset(dt, 0, sizeof(*dt));
+	dt->tail = &dt->head;
+}
+
+static void dev_table_add(struct dev_table *dt, char *name)
+{
+	struct dev_seen **sp, *seen;
+	struct mddev_dev *d;
+	unsigned int h = 0;
+	char *c;
+
+	for (c = name; *c; c++)
+		h = h * 31 + (unsigned char)*c;
+	sp = &dt->hash[h % DEV_TABLE_HASH];
+	for (seen = *sp; seen; seen = seen->next)
+		if (strcmp(seen->dv->devname, name) == 0)
+			return;
+
+	d = xcalloc(1, sizeof(*d));
+	d->devname = xstrdup(name);
+	*dt->tail = d;
+	dt->tail = &d->next;
+
+	seen = xmalloc(sizeof(*seen));
+	seen->dv = d;
+	seen->next = *sp;
+	*sp = seen;
+}
+
+/* Return the list, and free the hash */
+static struct mddev_dev *dev_table_done(struct dev_table *dt)
+{
+	int i;
+
+	for (i = 0; i < DEV_TABLE_HASH; i++)
+		while (dt->hash[i]) {
+			struct dev_seen *seen = dt->hash[i];
+			dt->hash[i] = seen->next;
+			free(seen);
+		}
+	return dt->head;
+}
+
+/* Nothing smaller than this (in 1K blocks) can hold md metadata;
+ * v1.x needs at least 24 sectors.  This mainly skips the one-block
+ * entries for extended partitions.
+ */
+#define MIN_PART_BLOCKS 12
+
+static void load_partitions(struct dev_table *dt)
 {
 	FILE *f = fopen("/proc/partitions", "r");
 	char buf[1024];
 	struct mddev_dev *rv = NULL;
 	if (f == NULL) {
 		pr_err("cannot open /proc/partitions\n");
-		return NULL;
+		return;
 	}
 	while (fgets(buf, 1024, f)) {
 		int major, minor;
+		unsigned long long blocks;
 		char *name, *mp;
 		struct mddev_dev *d;
 
@@ -135,55 +204,60 @@ struct mddev_dev *load_partitions(void)
 		major = strtoul(buf, &mp, 10);
 		if (mp == buf || *mp != ' ')
 			continue;
-		minor = strtoul(mp, NULL, 10);
+		minor = strtoul(mp, &mp, 10);
+		blocks = strtoull(mp, NULL, 10);
+		if (blocks < MIN_PART_BLOCKS)
+			continue;
 
 		name = map_dev(major, minor, 1);
 		if (!name)
 			continue;
+		/* Keep the order that building the list by
+		 * prepending always gave.
+		 */
 		d = xmalloc(sizeof(*d));
-		memset(d, 0, sizeof(*d));
 		d->devname = xstrdup(name);
 		d->next = rv;
 		rv = d;
 	}
 	fclose(f);
-	return rv;
+	while (rv) {
+		struct mddev_dev *d = rv;
+		rv = d->next;
+		dev_table_add(dt, d->devname);
+		free(d->devname);
+		free(d);
+	}
 }
 
-struct mddev_dev *load_containers(void)
+static void load_containers(struct dev_table *dt)
 {
 	struct mdstat_ent *mdstat = mdstat_read(0, 0);
 	struct mdstat_ent *ent;
-	struct mddev_dev *d;
-	struct mddev_dev *rv = NULL;
 	struct map_ent *map = NULL, *me;
 
 	if (!mdstat)
-		return NULL;
+		return;
 
 	for (ent = mdstat; ent; ent = ent->next)
 		if (ent->metadata_version &&
 		    strncmp(ent->metadata_version, "external:", 9) == 0 &&
 		    !is_subarray(&ent->metadata_version[9])) {
-			d = xmalloc(sizeof(*d));
-			memset(d, 0, sizeof(*d));
+			char *devname;
+
 			me = map_by_devnm(&map, ent->dev);
 			if (me)
-				d->devname = xstrdup(me->path);
-			else if (asprintf(&d->devname, "/dev/%s", ent->dev) < 0) {
-				free(d);
+				devname = xstrdup(me->path);
+			else if (asprintf(&devname, "/dev/%s", ent->dev) < 0)
 				continue;
-			}
-			d->next = rv;
-			rv = d;
+			dev_table_add(dt, devname);
+			free(devname);
 		}
 	free_mdstat(mdstat);
 	map_free(map);
-
-	return rv;
 }
 
-struct createinfo createinfo = {
+static const struct createinfo createinfo_default = {
 	.autof = 2, /* by default, create devices with standard names */
 	.symlinks = 1,
 	.names = 0, /* By default, stick with numbered md devices. */
@@ -195,6 +269,7 @@ struct createinfo createinfo = {
 	.mode = 0600,
 #endif
 };
+struct createinfo createinfo;
 
 int parse_auto(char *str, char *msg, int config)
 {
@@ -698,44 +773,338 @@ void set_conffile(char *file)
 	conffile = file;
 }
 
+static void conf_dispatch(char *line)
+{
+	switch(match_keyword(line)) {
+	case Devices:
+		devline(line);
+		break;
+	case Array:
+		arrayline(line);
+		break;
+	case Mailaddr:
+		mailline(line);
+		break;
+	case Mailfrom:
+		mailfromline(line);
+		break;
+	case Program:
+		programline(line);
+		break;
+	case CreateDev:
+		createline(line);
+		break;
+	case Homehost:
+		homehostline(line);
+		break;
+	case AutoMode:
+		autoline(line);
+		break;
+	case Policy:
+		policyline(line, rule_policy);
+		break;
+	case PartPolicy:
+		policyline(line, rule_part);
+		break;
+	default:
+		pr_err("Unknown keyword %s\n", line);
+	}
+}
+
+/*
+ * Config cache.
+ *
+ * mdadm is often run many times in quick succession (e.g. once for
+ * each device by udev) and each run would otherwise re-read
+ * mdadm.conf a character at a time.  So after parsing, the lines are
+ * saved in CONF_CACHE in the same form that conf_line() produces:
+ * each word is preceded by a dlink header, with offsets in place of
+ * pointers.  A later run can then mmap the cache, turn the offsets
+ * back into pointers, and hand the lines straight to the handlers.
+ *
+ * The cache records the inode, size and mtime of every file (and the
+ * .d directory) that was read, and of the files which were looked
+ * for but not found.  If any of those differ the cache is ignored and
+ * regenerated.  Setting MDADM_NO_CONF_CACHE=1 disables it.
+ */
+#ifndef CONF_CACHE
+#define CONF_CACHE MAP_DIR "/mdadm.conf.cache"
+#endif
+#define CONF_CACHE_MAGIC "mdcfc001"
+#define CONF_CACHE_SRCS 64
+
+struct conf_cache_src {
+	char	path[256];
+	__s64	size;		/* -1 if file did not exist */
+	__u64	ino;
+	__s64	mtime;
+	__s64	mtime_nsec;
+};
+
+struct conf_cache_head {
+	char	magic[8];
+	char	conffile[256];	/* as requested, not as found */
+	__u32	confdir;	/* the .d directory was also read */
+	__u32	srcs;		/* number of conf_cache_src that follow */
+	__u32	lines;		/* number of line offsets that follow those */
+	__u32	pad;
+	__u64	words;		/* offset of first word */
+	__u64	size;		/* size of whole file */
+};
+
+static struct conf_cache {
+	int	active;
+	int	srcs_ok;	/* src[] lists everything that was read */
+	struct conf_cache_head head;
+	struct conf_cache_src src[CONF_CACHE_SRCS];
+	__u64	*lines;
+	char	*words;
+	size_t	len, size;
+} cache;
+
+#define CACHE_ALIGN(n) ROUND_UP(n, sizeof(void *))
+
+static void conf_cache_src_set(struct conf_cache_src *src, struct stat *stb)
+{
+	if (stb) {
+		src->size = stb->st_size;
+		src->ino = stb->st_ino;
+		src->mtime = stb->st_mtim.tv_sec;
+		src->mtime_nsec = stb->st_mtim.tv_nsec;
+	} else {
+		src->size = -1;
+		src->ino = 0;
+		src->mtime = 0;
+		src->mtime_nsec = 0;
+	}
+}
+
+static int conf_cache_src_changed(struct conf_cache_src *src)
+{
+	struct conf_cache_src now;
+	struct stat stb;
+
+	if (stat(src->path, &stb) == 0)
+		conf_cache_src_set(&now, &stb);
+	else
+		conf_cache_src_set(&now, NULL);
+	return now.size != src->size ||
+		now.ino != src->ino ||
+		now.mtime != src->mtime ||
+		now.mtime_nsec != src->mtime_nsec;
+}
+
+static void conf_cache_start(char *file, int confdir)
+{
+	memset(&cache.head, 0, sizeof(cache.head));
+	cache.active = 0;
+	cache.srcs_ok = 1;
+	if (check_env("MDADM_NO_CONF_CACHE") ||
+	    strlen(file) >= sizeof(cache.head.conffile))
+		return;
+	memcpy(cache.head.magic, CONF_CACHE_MAGIC, 8);
+	strcpy(cache.head.conffile, file);
+	cache.head.confdir = confdir;
+	cache.active = 1;
+}
+
+static void conf_cache_add_src(char *path, FILE *f)
+{
+	/* Record a file we read, or tried to read.  This is done
+	 * even when the cache is disabled so that conf_changed()
+	 * can tell when the config must be read again.
+	 */
+	struct conf_cache_src *src;
+	struct stat stb;
+
+	if (!cache.srcs_ok)
+		return;
+	if (cache.head.srcs >= CONF_CACHE_SRCS ||
+	    strlen(path) >= sizeof(src->path)) {
+		cache.active = 0;
+		cache.srcs_ok = 0;
+		return;
+	}
+	src = &cache.src[cache.head.srcs++];
+	strcpy(src->path, path);
+	if (f && fstat(fileno(f), &stb) == 0)
+		conf_cache_src_set(src, &stb);
+	else
+		conf_cache_src_set(src, NULL);
+}
+
+static void conf_cache_add_line(char *line)
+{
+	char *w = line;
+	size_t first = 0, prev = 0;
+	int nwords = 0;
+
+	if (!cache.active)
+		return;
+	if ((cache.head.lines & 63) == 0)
+		cache.lines = xrealloc(cache.lines,
+				       (cache.head.lines + 64) * sizeof(__u64));
+	do {
+		size_t need = CACHE_ALIGN(sizeof(struct __dl_head) +
+					  strlen(w) + 1);
+		size_t off = cache.len + sizeof(struct __dl_head);
+		char *n;
+
+		if (cache.len + need > cache.size) {
+			cache.size = (cache.len + need) * 2;
+			cache.words = xrealloc(cache.words, cache.size);
+		}
+		memset(cache.words + cache.len, 0, need);
+		n = cache.words + off;
+		strcpy(n, w);
+		if (nwords++ == 0)
+			first = off;
+		else {
+			dl_next(cache.words + prev) = (void *)off;
+			dl_prev(n) = (void *)prev;
+		}
+		prev = off;
+		cache.len += need;
+	} while ((w = dl_next(w)) != line);
+	dl_next(cache.words + prev) = (void *)first;
+	dl_prev(cache.words + first) = (void *)prev;
+	cache.lines[cache.head.lines++] = first;
+}
+
+static void conf_cache_write(void)
+{
+	char tmp[] = CONF_CACHE ".XXXXXX";
+	FILE *f;
+	int fd;
+	int err;
+
+	if (!cache.active)
+		return;
+	cache.active = 0;
+	cache.head.words = CACHE_ALIGN(sizeof(cache.head) +
+				       cache.head.srcs * sizeof(cache.src[0]) +
+				       cache.head.lines * sizeof(__u64));
+	cache.head.size = cache.head.words + cache.len;
+
+	if (geteuid() != 0)
+		goto out;
+	(void)mkdir(MAP_DIR, 0755);
+	/* Several mdadm may be writing at once, e.g. from udev */
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto out;
+	fchmod(fd, 0644);
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+	fwrite(&cache.head, sizeof(cache.head), 1, f);
+	fwrite(cache.src, sizeof(cache.src[0]), cache.head.srcs, f);
+	fwrite(cache.lines, sizeof(__u64), cache.head.lines, f);
+	fseek(f, cache.head.words, SEEK_SET);
+	fwrite(cache.words, 1, cache.len, f);
+	fflush(f);
+	err = ferror(f);
+	fclose(f);
+	if (err || rename(tmp, CONF_CACHE) != 0)
+		unlink(tmp);
+out:
+	free(cache.lines);
+	free(cache.words);
+	cache.lines = NULL;
+	cache.words = NULL;
+	cache.len = cache.size = 0;
+}
+
+static int conf_cache_load(char *file, int confdir)
+{
+	/* If the cache is still valid, feed every line in it to
+	 * the handlers and return 1.  Otherwise return 0.
+	 */
+	struct conf_cache_head *head;
+	struct conf_cache_src *src;
+	__u64 *lines;
+	char *map, *words;
+	size_t mlen, wlen;
+	struct stat stb;
+	unsigned int i;
+	int fd;
+	int rv = 0;
+
+	if (check_env("MDADM_NO_CONF_CACHE"))
+		return 0;
+	fd = open(CONF_CACHE, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &stb) != 0 ||
+	    stb.st_size < (off_t)sizeof(*head)) {
+		close(fd);
+		return 0;
+	}
+	mlen = stb.st_size;
+	map = mmap(NULL, mlen, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	head = (struct conf_cache_head *)map;
+	src = (struct conf_cache_src *)(head + 1);
+	lines = (__u64 *)(src + head->srcs);
+	if (memcmp(head->magic, CONF_CACHE_MAGIC, 8) != 0 ||
+	    head->size != mlen ||
+	    head->srcs > CONF_CACHE_SRCS ||
+	    (char *)(lines + head->lines) > map + head->words ||
+	    head->words > head->size ||
+	    head->confdir != (__u32)confdir ||
+	    strncmp(head->conffile, file, sizeof(head->conffile)) != 0)
+		goto out;
+
+	for (i = 0; i < head->srcs; i++)
+		if (conf_cache_src_changed(&src[i]))
+			goto out;
+
+	/* Cache is current.  Turn offsets into pointers, checking
+	 * them all before any line is processed so that a damaged
+	 * cache is ignored entirely rather than half used.
+	 */
+	words = map + head->words;
+	wlen = mlen - head->words;
+	for (i = 0; i < head->lines; i++) {
+		char *line = words + lines[i];
+		char *w = line;
+
+		if (lines[i] >= wlen)
+			goto out;
+		do {
+			size_t prev = (size_t)dl_prev(w);
+			size_t next = (size_t)dl_next(w);
+
+			if (prev >= wlen || next >= wlen)
+				goto out;
+			dl_prev(w) = words + prev;
+			dl_next(w) = words + next;
+			w = dl_next(w);
+		} while (w != line);
+	}
+	for (i = 0; i < head->lines; i++)
+		conf_dispatch(words + lines[i]);
+	memcpy(cache.src, src, head->srcs * sizeof(*src));
+	cache.head.srcs = head->srcs;
+	cache.srcs_ok = 1;
+	rv = 1;
+out:
+	munmap(map, mlen);
+	return rv;
+}
+
 void conf_file(FILE *f)
 {
 	char *line;
 	while ((line=conf_line(f))) {
-		switch(match_keyword(line)) {
-		case Devices:
-			devline(line);
-			break;
-		case Array:
-			arrayline(line);
-			break;
-		case Mailaddr:
-			mailline(line);
-			break;
-		case Mailfrom:
-			mailfromline(line);
-			break;
-		case Program:
-			programline(line);
-			break;
-		case CreateDev:
-			createline(line);
-			break;
-		case Homehost:
-			homehostline(line);
-			break;
-		case AutoMode:
-			autoline(line);
-			break;
-		case Policy:
-			policyline(line, rule_policy);
-			break;
-		case PartPolicy:
-			policyline(line, rule_part);
-			break;
-		default:
-			pr_err("Unknown keyword %s\n", line);
-		}
+		conf_cache_add_line(line);
+		conf_dispatch(line);
 		free_line(line);
 	}
 }
@@ -745,13 +1114,14 @@ struct fname {
 	char name[];
 };
 
-void conf_file_or_dir(FILE *f)
+void conf_file_or_dir(FILE *f, char *path)
 {
 	struct stat st;
 	DIR *dir;
 	struct dirent *dp;
 	struct fname *list = NULL;
 
+	conf_cache_add_src(path, f);
 	fstat(fileno(f), &st);
 	if (S_ISREG(st.st_mode))
 		conf_file(f);
@@ -785,15 +1155,24 @@ void conf_file_or_dir(FILE *f)
 		FILE *f2;
 		struct fname *fn = list;
 		list = list->next;
+		char *fpath = NULL;
 		fd = openat(fileno(f), fn->name, O_RDONLY);
+		xasprintf(&fpath, "%s/%s", path, fn->name);
 		free(fn);
-		if (fd < 0)
+		if (fd < 0) {
+			conf_cache_add_src(fpath, NULL);
+			free(fpath);
 			continue;
+		}
 		f2 = fdopen(fd, "r");
 		if (!f2) {
 			close(fd);
+			conf_cache_add_src(fpath, NULL);
+			free(fpath);
 			continue;
 		}
+		conf_cache_add_src(fpath, f2);
+		free(fpath);
 		conf_file(f2);
 		fclose(f2);
 	}
@@ -804,48 +1183,59 @@ void conf_file_or_dir(FILE *f)
 void load_conffile(void)
 {
 	FILE *f;
+	char *file = conffile;
 	char *confdir = NULL;
 	char *head;
 
 	if (loaded)
 		return;
-	if (conffile == NULL) {
-		conffile = DefaultConfFile;
+	if (file == NULL) {
+		file = DefaultConfFile;
 		confdir = DefaultConfDir;
 	}
+	createinfo = createinfo_default;
+	cache.head.srcs = 0;
+	cache.srcs_ok = 1;
 
-	if (strcmp(conffile, "partitions")==0) {
+	if (strcmp(file, "partitions")==0) {
 		char *list = dl_strdup("DEV");
 		dl_init(list);
 		dl_add(list, dl_strdup("partitions"));
 		devline(list);
 		free_line(list);
-	} else if (strcmp(conffile, "none") != 0) {
-		f = fopen(conffile, "r");
+	} else if (strcmp(file, "none") != 0 &&
+		   !conf_cache_load(file, confdir != NULL)) {
+		conf_cache_start(file, confdir != NULL);
+		f = fopen(file, "r");
+		if (f == NULL)
+			conf_cache_add_src(file, NULL);
 		/* Debian chose to relocate mdadm.conf into /etc/mdadm/.
 		 * To allow Debian users to compile from clean source and still
 		 * have a working mdadm, we read /etc/mdadm/mdadm.conf
 		 * if /etc/mdadm.conf doesn't exist
 		 */
 		if (f == NULL &&
-		    conffile == DefaultConfFile) {
+		    file == DefaultConfFile) {
 			f = fopen(DefaultAltConfFile, "r");
 			if (f) {
-				conffile = DefaultAltConfFile;
+				file = DefaultAltConfFile;
 				confdir = DefaultAltConfDir;
-			}
+			} else
+				conf_cache_add_src(DefaultAltConfFile, NULL);
 		}
 		if (f) {
-			conf_file_or_dir(f);
+			conf_file_or_dir(f, file);
 			fclose(f);
 		}
 		if (confdir) {
 			f = fopen(confdir, "r");
 			if (f) {
-				conf_file_or_dir(f);
+				conf_file_or_dir(f, confdir);
 				fclose(f);
-			}
+			} else
+				conf_cache_add_src(confdir, NULL);
 		}
+		conf_cache_write();
 	}
 	/* If there was no AUTO line, process an empty line
 	 * now so that the MDADM_CONF_AUTO env var gets processed.
@@ -858,6 +1248,64 @@ void load_conffile(void)
 	loaded = 1;
 }
 
+/* Report whether any file the config was loaded from has changed,
+ * been created or been removed since.
+ */
+int conf_changed(void)
+{
+	unsigned int i;
+
+	if (!loaded)
+		return 0;
+	if (!cache.srcs_ok)
+		return 1;
+	for (i = 0; i < cache.head.srcs; i++)
+		if (conf_cache_src_changed(&cache.src[i]))
+			return 1;
+	return 0;
+}
+
+/* Forget everything loaded from the config so that the next
+ * conf_get_*() reads it again.  Nothing returned by those may
+ * be used after this.
+ */
+void conf_unload(void)
+{
+	if (!loaded)
+		return;
+	while (cdevlist) {
+		struct conf_dev *cd = cdevlist;
+
+		cdevlist = cd->next;
+		free(cd->name);
+		free(cd);
+	}
+	while (mddevlist) {
+		struct mddev_ident *mi = mddevlist;
+
+		mddevlist = mi->next;
+		free(mi->devname);
+		free(mi->devices);
+		free(mi->spare_group);
+		free(mi->bitmap_file);
+		free(mi->container);
+		free(mi->member);
+		free(mi->st);
+		free(mi);
+	}
+	mddevlp = &mddevlist;
+	free(createinfo.supertype);
+	free(alert_email);
+	free(alert_mail_from);
+	free(alert_program);
+	free(home_host);
+	alert_email = alert_mail_from = alert_program = home_host = NULL;
+	require_homehost = 1;
+	auto_seen = 0;
+	policy_free();
+	loaded = 0;
+}
+
 char *conf_get_mailaddr(void)
 {
 	load_conffile();
@@ -901,20 +1349,14 @@ struct mddev_ident *conf_get_ident(char *dev)
 	return rv;
 }
 
-static void append_dlist(struct mddev_dev **dlp, struct mddev_dev *list)
-{
-	while (*dlp)
-		dlp = &(*dlp)->next;
-	*dlp = list;
-}
-
 struct mddev_dev *conf_get_devs()
 {
 	glob_t globbuf;
 	struct conf_dev *cd;
+	struct dev_table dt;
 	int flags = 0;
 	static struct mddev_dev *dlist = NULL;
-	unsigned int i;
+	int i;
 
 	while (dlist) {
 		struct mddev_dev *t = dlist;
@@ -924,35 +1366,35 @@ struct mddev_dev *conf_get_devs()
 	}
 
 	load_conffile();
+	dev_table_init(&dt);
+
+	for (cd=cdevlist; cd; cd=cd->next)
+		if (strcasecmp(cd->name, "partitions") != 0 &&
+		    strcasecmp(cd->name, "containers") != 0) {
+			glob(cd->name, flags, NULL, &globbuf);
+			flags |= GLOB_APPEND;
+		}
+	if (flags & GLOB_APPEND) {
+		/* glob matches have always come first, last match first */
+		for (i = globbuf.gl_pathc - 1; i >= 0; i--)
+			dev_table_add(&dt, globbuf.gl_pathv[i]);
+		globfree(&globbuf);
+	}
 
 	if (cdevlist == NULL) {
 		/* default to 'partitions' and 'containers' */
-		dlist = load_partitions();
-		append_dlist(&dlist, load_containers());
+		load_partitions(&dt);
+		load_containers(&dt);
 	}
 
 	for (cd=cdevlist; cd; cd=cd->next) {
 		if (strcasecmp(cd->name, "partitions")==0)
-			append_dlist(&dlist, load_partitions());
+			load_partitions(&dt);
 		else if (strcasecmp(cd->name, "containers")==0)
-			append_dlist(&dlist, load_containers());
-		else {
-			glob(cd->name, flags, NULL, &globbuf);
-			flags |= GLOB_APPEND;
-		}
-	}
-	if (flags & GLOB_APPEND) {
-		for (i=0; i<globbuf.gl_pathc; i++) {
-			struct mddev_dev *t = xmalloc(sizeof(*t));
-			memset(t, 0, sizeof(*t));
-			t->devname = xstrdup(globbuf.gl_pathv[i]);
-			t->next = dlist;
-			dlist = t;
-/*	printf("one dev is %s\n", t->devname);*/
-		}
-		globfree(&globbuf);
+			load_containers(&dt);
 	}
 
+	dlist = dev_table_done(&dt);
 	return dlist;
 }
 
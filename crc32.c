@@ -53,7 +53,6 @@
 #define OF(X) X
 #define ZEXPORT
 typedef long ptrdiff_t;
-#define NOBYFOUR
 
 #define local static
 
@@ -91,6 +90,17 @@ typedef long ptrdiff_t;
 #  define TBLS 1
 #endif /* BYFOUR */
 
+/* On x86-64 large buffers are folded with carry-less multiplication
+ * when the CPU has PCLMULQDQ; this is checked at run time.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#  define CRC32_PCLMUL
+#  define PCLMUL_MIN_LEN 64
+   local int crc32_use_pclmul OF((void));
+   local unsigned long crc32_pclmul OF((unsigned long,
+                        const unsigned char FAR *, unsigned));
+#endif
+
 #ifdef DYNAMIC_CRC_TABLE
 
 local volatile int crc_table_empty = 1;
@@ -251,6 +261,18 @@ unsigned long ZEXPORT crc32(
         make_crc_table();
 #endif /* DYNAMIC_CRC_TABLE */
 
+#ifdef CRC32_PCLMUL
+    if (len >= PCLMUL_MIN_LEN && crc32_use_pclmul()) {
+        unsigned n = len & ~15U;
+
+        crc = crc32_pclmul(crc, buf, n);
+        buf += n;
+        len -= n;
+        if (!len)
+            return crc;
+    }
+#endif /* CRC32_PCLMUL */
+
 #ifdef BYFOUR
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
         u4 endian;
@@ -282,16 +304,16 @@ unsigned long ZEXPORT crc32(
 #define DOLIT32 DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4
 
 /* ========================================================================= */
-local unsigned long crc32_little(crc, buf, len)
-    unsigned long crc;
-    const unsigned char FAR *buf;
-    unsigned len;
+local unsigned long crc32_little(
+	unsigned long crc,
+	const unsigned char FAR *buf,
+	unsigned len)
 {
     register u4 c;
     register const u4 FAR *buf4;
 
+    /* No pre- or post-conditioning, to match crc32() */
     c = (u4)crc;
-    c = ~c;
     while (len && ((ptrdiff_t)buf & 3)) {
         c = crc_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
         len--;
@@ -311,7 +333,6 @@ local unsigned long crc32_little(crc, buf, len)
     if (len) do {
         c = crc_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
     } while (--len);
-    c = ~c;
     return (unsigned long)c;
 }
 
@@ -322,16 +343,15 @@ local unsigned long crc32_little(crc, buf, len)
 #define DOBIG32 DOBIG4; DOBIG4; DOBIG4; DOBIG4; DOBIG4; DOBIG4; DOBIG4; DOBIG4
 
 /* ========================================================================= */
-local unsigned long crc32_big(crc, buf, len)
-    unsigned long crc;
-    const unsigned char FAR *buf;
-    unsigned len;
+local unsigned long crc32_big(
+	unsigned long crc,
+	const unsigned char FAR *buf,
+	unsigned len)
 {
     register u4 c;
     register const u4 FAR *buf4;
 
     c = REV((u4)crc);
-    c = ~c;
     while (len && ((ptrdiff_t)buf & 3)) {
         c = crc_table[4][(c >> 24) ^ *buf++] ^ (c << 8);
         len--;
@@ -353,8 +373,134 @@ local unsigned long crc32_big(crc, buf, len)
     if (len) do {
         c = crc_table[4][(c >> 24) ^ *buf++] ^ (c << 8);
     } while (--len);
-    c = ~c;
     return (unsigned long)(REV(c));
 }
 
 #endif /* BYFOUR */
+
+#ifdef CRC32_PCLMUL
+#include <immintrin.h>
+
+/* Fold 64 bytes at a time using the constants for the bit-reflected
+ * polynomial from Intel's "Fast CRC Computation for Generic Polynomials
+ * Using PCLMULQDQ Instruction", then Barrett-reduce to 32 bits.
+ * len must be a multiple of 16 and at least 64.
+ */
+__attribute__((target("pclmul,sse4.1")))
+local unsigned long crc32_pclmul(
+	unsigned long crc,
+	const unsigned char FAR *buf,
+	unsigned len)
+{
+    static const unsigned long long k1k2[2] __attribute__((aligned(16))) =
+        { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const unsigned long long k3k4[2] __attribute__((aligned(16))) =
+        { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const unsigned long long k5k0[2] __attribute__((aligned(16))) =
+        { 0x0163cd6124ULL, 0 };
+    static const unsigned long long poly[2] __attribute__((aligned(16))) =
+        { 0x01db710641ULL, 0x01f7011641ULL };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    /* fold four 128bit lanes in parallel */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    /* fold the four lanes into one */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* then any remaining 16 byte blocks */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* 128 bits to 64 */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (unsigned int)_mm_extract_epi32(x1, 1);
+}
+
+/* Decide once whether to use crc32_pclmul(): the CPU must support it,
+ * and it must agree with the table method on a test pattern.
+ */
+local int crc32_use_pclmul(void)
+{
+    static int use = -1;
+    unsigned char test[256];
+    unsigned long table;
+    unsigned i, c;
+
+    if (use >= 0)
+        return use;
+    use = 0;
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("pclmul") ||
+        !__builtin_cpu_supports("sse4.1"))
+        return use;
+
+    for (i = 0; i < sizeof(test); i++)
+        test[i] = i * 37 + 11;
+    /* the table method: crc32() with pclmul still disabled */
+    table = crc32(0xffffffffUL, test, sizeof(test));
+    c = crc32_pclmul(0xffffffffUL, test, sizeof(test));
+    use = (c == table);
+    return use;
+}
+#endif /* CRC32_PCLMUL */
@@ -142,19 +142,65 @@ char *fd2devnm(int fd)
 /*
  * convert a major/minor pair for a block device into a name in /dev, if possible.
  * On the first call, walk /dev collecting name.
- * Put them in a simple linked listfor now.
+ * They are hashed by device number, as scanning /proc/partitions
+ * looks up every block device in the system.
  */
+#define DEVMAP_HASH 256
 struct devmap {
 	int major, minor;
 	char *name;
 	struct devmap *next;
-} *devlist = NULL;
+} *devmap_hash[DEVMAP_HASH];
 int devlist_ready = 0;
 
+/* Every directory walked, with its mtime at the time, so that a
+ * failed lookup only walks /dev again if a node may have been added
+ * somewhere in it.  mtimes are coarse, so a directory changed in the
+ * same second as the walk may change again without its mtime moving,
+ * and it is always treated as changed.
+ */
+static struct devdir {
+	char *name;
+	struct timespec mtime;
+} *devdirs;
+static int devdirs_cnt, devdirs_size;
+static time_t devdirs_walked;
+
+static struct devmap **devmap_bucket(int major, int minor)
+{
+	return &devmap_hash[((unsigned)major * 31 + (unsigned)minor)
+			    % DEVMAP_HASH];
+}
+
+static int devdirs_changed(void)
+{
+	struct stat stb;
+	int i;
+
+	for (i = 0; i < devdirs_cnt; i++)
+		if (devdirs[i].mtime.tv_sec >= devdirs_walked ||
+		    stat(devdirs[i].name, &stb) != 0 ||
+		    stb.st_mtim.tv_sec != devdirs[i].mtime.tv_sec ||
+		    stb.st_mtim.tv_nsec != devdirs[i].mtime.tv_nsec)
+			return 1;
+	return 0;
+}
+
 int add_dev(const char *name, const struct stat *stb, int flag, struct FTW *s)
 {
 	struct stat st;
 
+	if (flag == FTW_D && s) {
+		if (devdirs_cnt == devdirs_size) {
+			devdirs_size = devdirs_size ? devdirs_size * 2 : 64;
+			devdirs = xrealloc(devdirs,
+					   devdirs_size * sizeof(*devdirs));
+		}
+		devdirs[devdirs_cnt].name = xstrdup(name);
+		devdirs[devdirs_cnt].mtime = stb->st_mtim;
+		devdirs_cnt++;
+		return 0;
+	}
 	if (S_ISLNK(stb->st_mode)) {
 		if (stat(name, &st) != 0)
 			return 0;
@@ -164,14 +210,16 @@ int add_dev(const char *name, const struct stat *stb, int flag, struct FTW *s)
 	if ((stb->st_mode&S_IFMT)== S_IFBLK) {
 		char *n = xstrdup(name);
 		struct devmap *dm = xmalloc(sizeof(*dm));
+		struct devmap **bucket;
 		if (strncmp(n, "/dev/./", 7)==0)
 			strcpy(n+4, name+6);
 		if (dm) {
 			dm->major = major(stb->st_rdev);
 			dm->minor = minor(stb->st_rdev);
 			dm->name = n;
-			dm->next = devlist;
-			devlist = dm;
+			bucket = devmap_bucket(dm->major, dm->minor);
+			dm->next = *bucket;
+			*bucket = dm;
 		}
 	}
 	return 0;
@@ -217,12 +265,17 @@ char *map_dev_preferred(int major, int minor, int create,
 	if (!devlist_ready) {
 		char *dev = "/dev";
 		struct stat stb;
-		while(devlist) {
-			struct devmap *d = devlist;
-			devlist = d->next;
-			free(d->name);
-			free(d);
-		}
+		int i;
+		for (i = 0; i < DEVMAP_HASH; i++)
+			while (devmap_hash[i]) {
+				struct devmap *d = devmap_hash[i];
+				devmap_hash[i] = d->next;
+				free(d->name);
+				free(d);
+			}
+		while (devdirs_cnt)
+			free(devdirs[--devdirs_cnt].name);
+		devdirs_walked = time(0);
 		if (lstat(dev, &stb)==0 &&
 		    S_ISLNK(stb.st_mode))
 			dev = "/dev/.";
@@ -231,7 +284,7 @@ char *map_dev_preferred(int major, int minor, int create,
 		did_check = 1;
 	}
 
-	for (p=devlist; p; p=p->next)
+	for (p = *devmap_bucket(major, minor); p; p = p->next)
 		if (p->major == major &&
 		    p->minor == minor) {
 			if (strncmp(p->name, "/dev/md/",8) == 0
@@ -245,7 +298,8 @@ char *map_dev_preferred(int major, int minor, int create,
 					regular = p->name;
 			}
 		}
-	if (!regular && !preferred && !did_check) {
+	if (!regular && !preferred && !did_check &&
+	    devdirs_changed()) {
 		devlist_ready = 0;
 		goto retry;
 	}
@@ -401,6 +455,95 @@ void print_escape(char *str)
 	}
 }
 
+/*
+ * --export output.  Each value is normally printed as KEY=value on a
+ * line of its own for import into a shell.  With --json the values for
+ * each array form one JSON object instead, and "--detail --scan" lists
+ * the objects in an array.
+ */
+static int export_json, export_first, export_objects;
+
+static void json_escape(char *str)
+{
+	for (; *str; str++)
+		if (*str == '"' || *str == '\\')
+			printf("\\%c", *str);
+		else if ((unsigned char)*str < ' ')
+			printf("\\u%04x", *str);
+		else
+			putchar(*str);
+}
+
+void export_list_start(int json)
+{
+	export_objects = 0;
+	if (json)
+		printf("[\n");
+}
+
+void export_list_end(int json)
+{
+	if (json)
+		printf("%s]\n", export_objects ? "\n" : "");
+}
+
+void export_start(int json, char *dev)
+{
+	export_json = json;
+	if (!json)
+		return;
+	printf("%s{", export_objects++ ? ",\n" : "");
+	export_first = 1;
+	export_value("MD_ARRAY", "%s", dev);
+}
+
+void export_end(void)
+{
+	if (export_json)
+		printf("}");
+	export_json = 0;
+}
+
+void export_value(char *key, char *fmt, ...)
+{
+	char buf[1024];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (!export_json) {
+		printf("%s=%s\n", key, buf);
+		return;
+	}
+	printf("%s\"%s\": \"", export_first ? "" : ", ", key);
+	json_escape(buf);
+	putchar('"');
+	export_first = 0;
+}
+
+/* A name, with the changes print_escape() makes */
+void export_name(char *key, char *name)
+{
+	char buf[1024];
+	int i;
+
+	for (i = 0; name[i] && i < (int)sizeof(buf) - 1; i++)
+		switch (name[i]) {
+		case ' ':
+		case '\t':
+			buf[i] = '_';
+			break;
+		case '/':
+			buf[i] = '-';
+			break;
+		default:
+			buf[i] = name[i];
+		}
+	buf[i] = 0;
+	export_value(key, "%s", buf);
+}
+
 int check_env(char *name)
 {
 	char *val = getenv(name);
@@ -473,3 +616,191 @@ void free_line(char *line)
 	}
 	dl_free(line);
 }
+
+static int cmp_extent(const void *av, const void *bv)
+{
+	const struct dirty_extent *a = av, *b = bv;
+
+	if (a->start < b->start)
+		return -1;
+	return a->start > b->start;
+}
+
+/* Read a list of dirty extents as written by
+ * "mdadm --examine-bitmap --dirty-extents": one "start length" pair
+ * (in sectors) per line, '#' starting a comment.  "-" means stdin.
+ * Each extent is widened to a multiple of 'align' sectors (if non-zero)
+ * and the list is returned sorted with overlapping or adjacent extents
+ * merged.  Returns the number of extents or -1 on error.
+ */
+int read_dirty_extents(char *file, unsigned long long align,
+		       struct dirty_extent **listp)
+{
+	FILE *f;
+	char line[256];
+	struct dirty_extent *list = NULL;
+	int cnt = 0, space = 0;
+	int lineno = 0;
+	int i, n;
+
+	if (strcmp(file, "-") == 0)
+		f = stdin;
+	else
+		f = fopen(file, "r");
+	if (!f) {
+		pr_err("cannot open %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long start, length;
+		char *c = strchr(line, '#');
+
+		lineno++;
+		if (c)
+			*c = 0;
+		for (c = line; isspace(*c); c++)
+			;
+		if (!*c)
+			continue;
+		if (sscanf(c, "%llu %llu", &start, &length) != 2) {
+			pr_err("%s line %d: expected \"start length\"\n",
+			       file, lineno);
+			cnt = -1;
+			break;
+		}
+		if (!length)
+			continue;
+		if (align) {
+			unsigned long long end = start + length;
+
+			start -= start % align;
+			end = (end + align - 1) / align * align;
+			length = end - start;
+		}
+		if (cnt == space) {
+			space = space ? space * 2 : 64;
+			list = xrealloc(list, space * sizeof(*list));
+		}
+		list[cnt].start = start;
+		list[cnt].length = length;
+		cnt++;
+	}
+	if (f != stdin)
+		fclose(f);
+	if (cnt <= 0) {
+		free(list);
+		*listp = NULL;
+		return cnt;
+	}
+
+	qsort(list, cnt, sizeof(*list), cmp_extent);
+	for (i = 1, n = 0; i < cnt; i++) {
+		unsigned long long end = list[n].start + list[n].length;
+
+		if (list[i].start <= end) {
+			if (list[i].start + list[i].length > end)
+				list[n].length = list[i].start + list[i].length
+					- list[n].start;
+		} else
+			list[++n] = list[i];
+	}
+	*listp = list;
+	return n + 1;
+}
+
+static int cmp_bb_entry(const void *av, const void *bv)
+{
+	const struct md_bb_entry *a = av, *b = bv;
+
+	if (a->sector < b->sector)
+		return -1;
+	return a->sector > b->sector;
+}
+
+/* Add a bad range to the list.  md_bb_normalise() must be called
+ * before the list is searched.
+ */
+void md_bb_add(struct md_bb *bb, unsigned long long sector,
+	       unsigned long long length)
+{
+	if (bb->count == bb->space) {
+		bb->space = bb->space ? bb->space * 2 : 64;
+		bb->entries = xrealloc(bb->entries,
+				       bb->space * sizeof(bb->entries[0]));
+	}
+	bb->entries[bb->count].sector = sector;
+	bb->entries[bb->count].length = length;
+	bb->count++;
+}
+
+/* sort the list and merge overlapping or adjacent ranges */
+void md_bb_normalise(struct md_bb *bb)
+{
+	struct md_bb_entry *e = bb->entries;
+	int i, n;
+
+	if (bb->count < 2)
+		return;
+	qsort(e, bb->count, sizeof(*e), cmp_bb_entry);
+	for (i = 1, n = 0; i < bb->count; i++) {
+		unsigned long long end = e[n].sector + e[n].length;
+
+		if (e[i].sector <= end) {
+			if (e[i].sector + e[i].length > end)
+				e[n].length = e[i].sector + e[i].length
+					- e[n].sector;
+		} else
+			e[++n] = e[i];
+	}
+	bb->count = n + 1;
+}
+
+/* Return the index of the first bad range which overlaps
+ * [sector, sector+length), or -1 if there is none.
+ * Following entries can be tested in turn for further overlaps.
+ */
+int md_bb_find(struct md_bb *bb, unsigned long long sector,
+	       unsigned long long length)
+{
+	int lo = 0, hi = bb->count;
+
+	/* find the first entry which ends after 'sector' */
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		struct md_bb_entry *e = &bb->entries[mid];
+
+		if (e->sector + e->length <= sector)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < bb->count && bb->entries[lo].sector < sector + length)
+		return lo;
+	return -1;
+}
+
+void md_bb_free(struct md_bb *bb)
+{
+	free(bb->entries);
+	bb->entries = NULL;
+	bb->count = bb->space = 0;
+}
+
+/* Load the kernel's bad block list for one member device of an
+ * active array from sysfs, which is cheaper than reading the
+ * metadata and includes blocks not yet acknowledged.
+ * 'file' is the full path of the bad_blocks attribute.
+ */
+int md_bb_load_sysfs(char *file, struct md_bb *bb)
+{
+	FILE *f = fopen(file, "r");
+	unsigned long long sector, length;
+
+	if (!f)
+		return -1;
+	while (fscanf(f, "%llu %llu", &sector, &length) == 2)
+		md_bb_add(bb, sector, length);
+	fclose(f);
+	md_bb_normalise(bb);
+	return 0;
+}
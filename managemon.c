@@ -244,6 +244,7 @@ void check_update_queue(struct supertype *container)
 	    update_queue_pending) {
 		update_queue = update_queue_pending;
 		update_queue_pending = NULL;
+		mdmon_stats.queue_depth = 0;
 		wakeup_monitor();
 	}
 }
@@ -251,11 +252,17 @@ void check_update_queue(struct supertype *container)
 static void queue_metadata_update(struct metadata_update *mu)
 {
 	struct metadata_update **qp;
+	unsigned long depth = 1;
 
 	qp = &update_queue_pending;
-	while (*qp)
+	while (*qp) {
 		qp = & ((*qp)->next);
+		depth++;
+	}
 	*qp = mu;
+	mdmon_stats.queue_depth = depth;
+	if (depth > mdmon_stats.queue_max)
+		mdmon_stats.queue_max = depth;
 }
 
 static void add_disk_to_container(struct supertype *st, struct mdinfo *sd)
@@ -523,12 +530,14 @@ static void manage_member(struct mdstat_ent *mdstat,
 		struct mdinfo *newdev = NULL;
 		struct active_array *newa;
 		struct mdinfo *d;
+		struct timeval start;
 
 		a->check_degraded = 0;
 
 		/* The array may not be degraded, this is just a good time
 		 * to check.
 		 */
+		gettimeofday(&start, NULL);
 		newdev = container->ss->activate_spare(a, &updates);
 		if (!newdev)
 			return;
@@ -565,6 +574,7 @@ static void manage_member(struct mdstat_ent *mdstat,
 		    == 0)
 			newa->prev_action = recover;
 		dprintf("recovery started on %s\n", a->info.sys_name);
+		mdmon_hist_add(&mdmon_stats.activate_spare, &start);
  out:
 		while (newdev) {
 			d = newdev->next;
@@ -839,6 +849,81 @@ static void handle_message(struct supertype *container, struct metadata_update *
 	}
 }
 
+/* append to the buffer ending at 'end', never past it */
+static char *addf(char *p, char *end, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (p >= end)
+		return end;
+	va_start(ap, fmt);
+	n = vsnprintf(p, end - p, fmt, ap);
+	va_end(ap);
+	if (n < 0 || n >= end - p)
+		return end;
+	return p + n;
+}
+
+static char *print_hist(char *p, char *end, char *name,
+			struct mdmon_hist *h)
+{
+	int i;
+
+	p = addf(p, end, "%s count=%lu avg_us=%llu max_us=%lu",
+		 name, h->cnt, h->cnt ? h->total_us / h->cnt : 0, h->max_us);
+	for (i = 0; i < MDMON_HIST_BUCKETS; i++) {
+		if (!h->bucket[i])
+			continue;
+		if (i < MDMON_HIST_BUCKETS - 1)
+			p = addf(p, end, " <%luus=%lu",
+				 64UL << i, h->bucket[i]);
+		else
+			p = addf(p, end, " more=%lu", h->bucket[i]);
+	}
+	return addf(p, end, "\n");
+}
+
+/* The reply to 'mdadm --monitor-stats', one 'name key=value...' line
+ * per item.  The counters belong to the monitor and are read without
+ * locking, which is good enough for statistics.
+ */
+char *mdmon_stats_text(struct supertype *container)
+{
+	struct mdmon_stats *s = &mdmon_stats;
+	struct active_array *a;
+	int len = 2048;
+	char *buf, *p, *end;
+
+	for (a = container->arrays; a; a = a->next)
+		len += 256;
+	buf = xmalloc(len);
+	p = buf;
+	end = buf + len;
+
+	p = addf(p, end, "wakeups timeout=%lu signal=%lu array_state=%lu sync_action=%lu sync_completed=%lu disk_state=%lu\n",
+		 s->wake_timeout, s->wake_signal, s->wake_array_state,
+		 s->wake_sync_action, s->wake_sync_completed,
+		 s->wake_disk_state);
+	p = addf(p, end, "updates processed=%lu queued=%lu max_queued=%lu\n",
+		 s->updates, s->queue_depth, s->queue_max);
+	p = print_hist(p, end, "read_and_act", &s->read_and_act);
+	p = print_hist(p, end, "sync_metadata", &s->sync_metadata);
+	p = print_hist(p, end, "activate_spare", &s->activate_spare);
+	for (a = container->arrays; a; a = a->next) {
+		struct array_stats *as = &a->stats;
+
+		if (!a->container || a->to_remove)
+			continue;
+		p = addf(p, end, "array %s dirty=%lu clean=%lu held=%lu clean_hold_ms=%d md_writes=%lu md_write_avg_us=%llu md_write_max_us=%lu\n",
+			 a->info.sys_name, as->dirty, as->clean, as->held,
+			 a->clean_hold, as->md_writes,
+			 as->md_writes ? as->md_write_us / as->md_writes : 0,
+			 as->md_write_max_us);
+	}
+	return buf;
+}
+
 void read_sock(struct supertype *container)
 {
 	int fd;
@@ -860,6 +945,14 @@ void read_sock(struct supertype *container)
 
 		/* read and validate the message */
 		if (receive_message(fd, &msg, tmo) == 0) {
+			if (msg.len == -2) { /* mdmon_stats */
+				msg.buf = mdmon_stats_text(container);
+				msg.len = strlen(msg.buf) + 1;
+				if (send_message(fd, &msg, tmo) < 0)
+					terminate = 1;
+				free(msg.buf);
+				continue;
+			}
 			handle_message(container, &msg);
 			if (msg.len == 0) {
 				/* ping reply with version */
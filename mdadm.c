@@ -95,6 +95,8 @@ int main(int argc, char *argv[])
 	char *remove_path = NULL;
 	char *udev_filename = NULL;
 	char *dump_directory = NULL;
+	int incr_daemon = 0;
+	int incr_queue = 0;
 
 	int print_help = 0;
 	FILE *outf;
@@ -232,6 +234,9 @@ int main(int argc, char *argv[])
 		case Dump:
 		case Restore:
 		case Action:
+		case CheckDirtyOpt:
+		case BitmapAdviseOpt:
+		case MonitorStatsOpt:
 			newmode = MISC;
 			break;
 
@@ -572,6 +577,12 @@ int main(int argc, char *argv[])
 			s.assume_clean = 1;
 			continue;
 
+		case O(CREATE,WriteZeroes):
+			/* zeroed devices are in-sync for every level */
+			s.write_zeroes = 1;
+			s.assume_clean = 1;
+			continue;
+
 		case O(GROW,'n'):
 		case O(CREATE,'n'):
 		case O(BUILD,'n'): /* number of raid disks */
@@ -867,6 +878,7 @@ int main(int argc, char *argv[])
 			continue;
 		case O(MONITOR,'f'): /* daemonise */
 		case O(MONITOR,Fork):
+		case O(MONITOR,DaemonOpt): /* --daemon used to abbreviate --daemonise */
 			daemonise = 1;
 			continue;
 		case O(MONITOR,'i'): /* pid */
@@ -972,6 +984,9 @@ int main(int argc, char *argv[])
 		case O(MISC, Dump):
 		case O(MISC, Restore):
 		case O(MISC ,Action):
+		case O(MISC, CheckDirtyOpt):
+		case O(MISC, BitmapAdviseOpt):
+		case O(MISC, MonitorStatsOpt):
 			if (opt == KillSubarray || opt == UpdateSubarray) {
 				if (c.subarray) {
 					pr_err("subarray can only be specified once\n");
@@ -994,6 +1009,20 @@ int main(int argc, char *argv[])
 					exit(2);
 				}
 			}
+			if (opt == CheckDirtyOpt) {
+				if (c.check_dirty) {
+					pr_err("Only one --check-dirty list can be given\n");
+					exit(2);
+				}
+				c.check_dirty = optarg;
+			}
+			if (opt == BitmapAdviseOpt) {
+				if (c.bitmap_advise) {
+					pr_err("Only one --bitmap-advise workload can be given\n");
+					exit(2);
+				}
+				c.bitmap_advise = optarg;
+			}
 			if (devmode && devmode != opt &&
 			    (devmode == 'E' || (opt == 'E' && devmode != 'Q'))) {
 				pr_err("--examine/-E cannot be given with ");
@@ -1043,6 +1072,57 @@ int main(int argc, char *argv[])
 			c.SparcAdjust = 1;
 			continue;
 
+		case O(MISC, HistogramOpt):
+			if (devmode != 'X') {
+				pr_err("--histogram only allowed with --examine-bitmap\n");
+				exit(2);
+			}
+			if (!optarg)
+				c.histogram = 16;
+			else {
+				c.histogram = parse_num(optarg);
+				if (c.histogram < 1 || c.histogram > 4096) {
+					pr_err("invalid number of histogram regions: %s\n",
+					       optarg);
+					exit(2);
+				}
+			}
+			continue;
+
+		case O(MISC, BadblocksFormat):
+			if (devmode != ExamineBB) {
+				pr_err("--badblocks-format only allowed with --examine-badblocks\n");
+				exit(2);
+			}
+			if (strcmp(optarg, "text") == 0)
+				c.bb_format = BB_TEXT;
+			else if (strcmp(optarg, "json") == 0)
+				c.bb_format = BB_JSON;
+			else if (strcmp(optarg, "binary") == 0)
+				c.bb_format = BB_BINARY;
+			else {
+				pr_err("--badblocks-format must be one of text, json, binary\n");
+				exit(2);
+			}
+			continue;
+
+		case O(MISC, JsonOpt):
+			if (devmode != 'D') {
+				pr_err("--json only allowed with --detail\n");
+				exit(2);
+			}
+			c.export = 1;
+			c.json = 1;
+			continue;
+
+		case O(MISC, DirtyExtents):
+			if (devmode != 'X') {
+				pr_err("--dirty-extents only allowed with --examine-bitmap\n");
+				exit(2);
+			}
+			c.dirty_extents = 1;
+			continue;
+
 		case O(ASSEMBLE,'b'): /* here we simply set the bitmap file */
 		case O(ASSEMBLE,Bitmap):
 			if (!optarg) {
@@ -1137,6 +1217,12 @@ int main(int argc, char *argv[])
 		case O(INCREMENTAL, IncrementalPath):
 			remove_path = optarg;
 			continue;
+		case O(INCREMENTAL, DaemonOpt):
+			incr_daemon = 1;
+			continue;
+		case O(INCREMENTAL, QueueOpt):
+			incr_queue = 1;
+			continue;
 		}
 		/* We have now processed all the valid options. Anything else is
 		 * an error
@@ -1535,6 +1621,15 @@ int main(int argc, char *argv[])
 			}
 			rv = IncrementalScan(&c, NULL);
 		}
+		if (incr_daemon) {
+			if (devlist || c.scan || devmode == 'f') {
+				pr_err("--incremental --daemon does not take devices, --scan or --fail.\n");
+				rv = 1;
+				break;
+			}
+			rv = IncrementalDaemon(&c, ss);
+			break;
+		}
 		if (!devlist) {
 			if (!rebuild_map && !c.scan) {
 				pr_err("--incremental requires a device.\n");
@@ -1550,7 +1645,10 @@ int main(int argc, char *argv[])
 			}
 			rv = IncrementalRemove(devlist->devname, remove_path,
 					       c.verbose);
-		} else
+		} else if (incr_queue && !c.export && !ss && !configfile &&
+			   IncrementalQueue(devlist, &c) == 0)
+			rv = 0;
+		else
 			rv = Incremental(devlist, &c, ss);
 		break;
 	case AUTODETECT:
@@ -1647,14 +1745,19 @@ static int scan_assemble(struct supertype *ss,
 static int misc_scan(char devmode, struct context *c)
 {
 	/* apply --detail or --wait-clean to
-	 * all devices in /proc/mdstat
+	 * all devices in /proc/mdstat.
+	 * The mdstat and map snapshots, and loaded container metadata,
+	 * are shared by all arrays.
 	 */
 	struct mdstat_ent *ms = mdstat_read(0, 1);
 	struct mdstat_ent *e;
-	struct map_ent *map = NULL;
+	struct detail_scan ds = { .mdstat = ms };
 	int members;
 	int rv = 0;
 
+	if (devmode == 'D')
+		export_list_start(c->json);
+
 	for (members = 0; members <= 1; members++) {
 		for (e=ms ; e ; e=e->next) {
 			char *name = NULL;
@@ -1665,7 +1768,7 @@ static int misc_scan(char devmode, struct context *c)
 					"external:/", 10) == 0;
 			if (members != member)
 				continue;
-			me = map_by_devnm(&map, e->devnm);
+			me = map_by_devnm(&ds.map, e->devnm);
 			if (me && me->path
 			    && strcmp(me->path, "/unknown") != 0)
 				name = me->path;
@@ -1679,12 +1782,15 @@ static int misc_scan(char devmode, struct context *c)
 				continue;
 			}
 			if (devmode == 'D')
-				rv |= Detail(name, c);
+				rv |= __Detail(name, c, &ds);
 			else
 				rv |= WaitClean(name, -1, c->verbose);
 			put_md_name(name);
 		}
 	}
+	if (devmode == 'D')
+		export_list_end(c->json);
+	detail_scan_free(&ds);
 	free_mdstat(ms);
 	return rv;
 }
@@ -1747,23 +1853,21 @@ static int misc_list(struct mddev_dev *devlist,
 			rv |= Detail(dv->devname, c);
 			continue;
 		case KillOpt: /* Zero superblock */
-			if (ss)
-				rv |= Kill(dv->devname, ss, c->force, c->verbose,0);
-			else {
-				int v = c->verbose;
-				do {
-					rv |= Kill(dv->devname, NULL, c->force, v, 0);
-					v = -1;
-				} while (rv == 0);
-				rv &= ~2;
-			}
+			rv |= Kill_list(dv, ss, c->force, c->verbose);
+			while (dv->next && dv->next->disposition == KillOpt)
+				dv = dv->next;
 			continue;
 		case 'Q':
 			rv |= Query(dv->devname); continue;
 		case 'X':
-			rv |= ExamineBitmap(dv->devname, c->brief, ss); continue;
+			rv |= ExamineBitmap(dv->devname, c->brief,
+					    c->histogram, c->dirty_extents,
+					    ss);
+			continue;
 		case ExamineBB:
-			rv |= ExamineBadblocks(dv->devname, c->brief, ss); continue;
+			rv |= ExamineBadblocks(dv->devname, c->brief,
+					       c->bb_format, ss);
+			continue;
 		case 'W':
 		case WaitOpt:
 			rv |= Wait(dv->devname); continue;
@@ -1791,6 +1895,17 @@ static int misc_list(struct mddev_dev *devlist,
 		case Action:
 			rv |= SetAction(dv->devname, c->action);
 			continue;
+		case CheckDirtyOpt:
+			rv |= CheckDirty(dv->devname, c->check_dirty,
+					 c->verbose);
+			continue;
+		case BitmapAdviseOpt:
+			rv |= BitmapAdvise(dv->devname, c->bitmap_advise,
+					   c->force, c->verbose);
+			continue;
+		case MonitorStatsOpt:
+			rv |= MonitorStats(dv->devname, c->verbose);
+			continue;
 		}
 		if (dv->devname[0] == '/')
 			mdfd = open_mddev(dv->devname, 1);
@@ -1840,3 +1955,101 @@ int SetAction(char *dev, char *action)
 	}
 	return 0;
 }
+
+/* Run a 'check' over just the extents listed in 'list', as produced by
+ * "--examine-bitmap --dirty-extents", so that after a crash only the
+ * regions the bitmap says may be inconsistent need to be read.
+ * Each extent is checked in turn by limiting the check with sync_min
+ * and sync_max.
+ */
+int CheckDirty(char *dev, char *list, int verbose)
+{
+	int fd = open(dev, O_RDONLY);
+	struct mdinfo *sra;
+	struct dirty_extent *ext = NULL;
+	unsigned long long align, sectors = 0, mismatches = 0;
+	char action[20];
+	int cfd = -1;
+	int n, i;
+	int rv = 1;
+
+	if (fd < 0) {
+		pr_err("Couldn't open %s: %s\n", dev, strerror(errno));
+		return 1;
+	}
+	sra = sysfs_read(fd, NULL, GET_LEVEL|GET_CHUNK);
+	close(fd);
+	if (!sra) {
+		pr_err("%s is not an md array\n", dev);
+		return 1;
+	}
+	if (sra->array.level < 1) {
+		pr_err("%s has no redundancy to check\n", dev);
+		goto out;
+	}
+	if (sysfs_get_str(sra, NULL, "sync_action", action, 20) <= 0 ||
+	    strcmp(action, "idle\n") != 0) {
+		pr_err("%s is busy, cannot check it now\n", dev);
+		goto out;
+	}
+	/* sync_max must be a multiple of the chunk size */
+	align = sra->array.chunk_size >> 9;
+	if (!align)
+		align = 8;
+	n = read_dirty_extents(list, align, &ext);
+	if (n < 0)
+		goto out;
+
+	cfd = sysfs_get_fd(sra, NULL, "sync_completed");
+	if (cfd < 0) {
+		pr_err("%s does not support a limited check\n", dev);
+		goto out;
+	}
+	rv = 0;
+	for (i = 0; i < n && rv == 0; i++) {
+		unsigned long long end = ext[i].start + ext[i].length;
+		unsigned long long done, cnt = 0;
+
+		if (sysfs_set_num(sra, NULL, "sync_min", ext[i].start) < 0 ||
+		    sysfs_set_num(sra, NULL, "sync_max", end) < 0 ||
+		    sysfs_set_str(sra, NULL, "sync_action", "check") < 0) {
+			pr_err("Could not start check of %s at %llu: %s\n",
+			       dev, ext[i].start, strerror(errno));
+			rv = 1;
+			break;
+		}
+		/* The check pauses rather than finishing when it reaches
+		 * sync_max, so stop it once it gets there.
+		 */
+		while (1) {
+			int msec = 1000;
+
+			sysfs_wait(cfd, &msec);
+			if (sysfs_get_str(sra, NULL, "sync_action",
+					  action, 20) <= 0 ||
+			    strcmp(action, "check\n") != 0)
+				break;
+			if (sysfs_fd_get_ll(cfd, &done) == 0 && done >= end) {
+				sysfs_set_str(sra, NULL, "sync_action", "idle");
+				break;
+			}
+		}
+		if (sysfs_get_ll(sra, NULL, "mismatch_cnt", &cnt) == 0)
+			mismatches += cnt;
+		sectors += ext[i].length;
+		if (verbose > 0)
+			printf("mdadm: %s: checked %llu-%llu, %llu mismatches\n",
+			       dev, ext[i].start, end - 1, cnt);
+	}
+	sysfs_set_str(sra, NULL, "sync_max", "max");
+	sysfs_set_num(sra, NULL, "sync_min", 0);
+	if (rv == 0 && verbose >= 0)
+		printf("mdadm: %s: checked %d extent%s, %llu sectors: %llu mismatched sectors\n",
+		       dev, n, n == 1 ? "" : "s", sectors, mismatches);
+out:
+	if (cfd >= 0)
+		close(cfd);
+	free(ext);
+	sysfs_free(sra);
+	return rv;
+}
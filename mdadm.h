@@ -62,6 +62,9 @@ extern __off64_t lseek64 __P ((int __fd, __off64_t __offset, int __whence));
 #ifndef BLKGETSIZE64
 #define BLKGETSIZE64 _IOR(0x12,114,size_t) /* return device size in bytes (u64 *arg) */
 #endif
+#ifndef BLKZEROOUT
+#define BLKZEROOUT _IO(0x12,127) /* zero a byte range (u64 arg[2]: start, len) */
+#endif
 
 #define DEFAULT_CHUNK 512
 #define DEFAULT_BITMAP_CHUNK 4096
@@ -93,6 +96,13 @@ extern __off64_t lseek64 __P ((int __fd, __off64_t __offset, int __whence));
 #define MDMON_DIR "/run/mdadm"
 #endif /* MDMON_DIR */
 
+/* INCR_SOCK is where "mdadm --incremental --daemon" listens for
+ * devices passed to it by "mdadm --incremental --queue".
+ */
+#ifndef INCR_SOCK
+#define INCR_SOCK MAP_DIR "/incremental.sock"
+#endif /* INCR_SOCK */
+
 /* FAILED_SLOTS is where to save files storing recent removal of array
  * member in order to allow future reuse of disk inserted in the same
  * slot for array recovery
@@ -344,6 +354,16 @@ enum special_options {
 	Dump,
 	Restore,
 	Action,
+	DaemonOpt,
+	QueueOpt,
+	WriteZeroes,
+	HistogramOpt,
+	DirtyExtents,
+	CheckDirtyOpt,
+	BitmapAdviseOpt,
+	BadblocksFormat,
+	MonitorStatsOpt,
+	JsonOpt,
 };
 
 enum prefix_standard {
@@ -407,11 +427,17 @@ struct context {
 	int	require_homehost;
 	char	*prefer;
 	int	export;
+	int	json;
 	int	test;
 	char	*subarray;
 	char	*update;
 	int	scan;
 	int	SparcAdjust;
+	int	histogram;
+	int	dirty_extents;
+	char	*check_dirty;
+	char	*bitmap_advise;
+	int	bb_format;
 	int	autof;
 	int	delay;
 	int	freeze_reshape;
@@ -430,6 +456,7 @@ struct shape {
 	int	bitmap_chunk;
 	char	*bitmap_file;
 	int	assume_clean;
+	int	write_zeroes;
 	int	write_behind;
 	unsigned long long size;
 };
@@ -625,6 +652,7 @@ static inline char *map_dev(int major, int minor, int create)
 
 struct active_array;
 struct metadata_update;
+struct md_bb;
 
 /* 'struct reshape' records the intermediate states of
  * a general reshape.
@@ -691,7 +719,11 @@ extern struct superswitch {
 	void (*brief_examine_super)(struct supertype *st, int verbose);
 	void (*brief_examine_subarrays)(struct supertype *st, int verbose);
 	void (*export_examine_super)(struct supertype *st);
-	int (*examine_badblocks)(struct supertype *st, int fd, char *devname);
+	/* Decode the bad-block log into 'bb', which starts empty.
+	 * Returns 0 on success, 1 on error, or 2 if the metadata
+	 * has no bad-block log configured.
+	 */
+	int (*get_bad_blocks)(struct supertype *st, int fd, struct md_bb *bb);
 	int (*copy_metadata)(struct supertype *st, int from, int to);
 
 	/* Used to report details of an active array.
@@ -1018,6 +1050,9 @@ struct supertype {
 				 Used when examining metadata to display content of disk
 				 when user has no hw/firmare compatible system.
 			      */
+	int bitmap_clean; /* a new internal bitmap can have no bits set,
+			   * as the array is known to be in sync.
+			   */
 	struct metadata_update *updates;
 	struct metadata_update **update_tail;
 
@@ -1042,6 +1077,19 @@ static inline struct supertype *guess_super(int fd) {
 }
 extern struct supertype *dup_super(struct supertype *st);
 extern int get_dev_size(int fd, char *dname, unsigned long long *sizep);
+extern unsigned long long sum_le32(const void *buf, int len);
+/* One I/O of a batch for md_io_batch() */
+struct md_io {
+	int fd;
+	int write;
+	void *buf;
+	size_t len;
+	unsigned long long offset;
+	long long rv;	/* bytes transferred or -errno */
+};
+extern int md_io_batch(struct md_io *io, int cnt);
+extern void run_jobs(int cnt, int max, int (*fn)(void *arg, int i),
+		     void *arg, int *rv);
 extern int must_be_container(int fd);
 extern int dev_size_from_id(dev_t id, unsigned long long *size);
 void wait_for(char *dev, int fd);
@@ -1229,9 +1277,21 @@ extern int Create(struct supertype *st, char *mddev,
 		  unsigned long long data_offset);
 
 extern int Detail(char *dev, struct context *c);
+/* Shared by all the arrays of a "--detail --scan" */
+struct detail_scan {
+	struct mdstat_ent *mdstat;
+	struct map_ent *map;
+	struct supertype **containers;	/* loaded container metadata */
+	int ncontainers;
+};
+extern int __Detail(char *dev, struct context *c, struct detail_scan *ds);
+extern void detail_scan_free(struct detail_scan *ds);
 extern int Detail_Platform(struct superswitch *ss, int scan, int verbose, int export, char *controller_path);
 extern int Query(char *dev);
-extern int ExamineBadblocks(char *devname, int brief, struct supertype *forcest);
+enum bb_format { BB_TEXT, BB_JSON, BB_BINARY };
+#define MD_BB_MAGIC 0x4242444d /* "MDBB" */
+extern int ExamineBadblocks(char *devname, int brief, int format,
+			    struct supertype *forcest);
 extern int Examine(struct mddev_dev *devlist, struct context *c,
 		   struct supertype *forcest);
 extern int Monitor(struct mddev_dev *devlist,
@@ -1242,23 +1302,31 @@ extern int Monitor(struct mddev_dev *devlist,
 		   int share);
 
 extern int Kill(char *dev, struct supertype *st, int force, int verbose, int noexcl);
+extern int Kill_list(struct mddev_dev *devlist, struct supertype *st,
+		     int force, int verbose);
 extern int Kill_subarray(char *dev, char *subarray, int verbose);
 extern int Update_subarray(char *dev, char *subarray, char *update, struct mddev_ident *ident, int quiet);
 extern int Wait(char *dev);
 extern int WaitClean(char *dev, int sock, int verbose);
+extern int MonitorStats(char *dev, int verbose);
 extern int SetAction(char *dev, char *action);
+extern int CheckDirty(char *dev, char *list, int verbose);
 
 extern int Incremental(struct mddev_dev *devlist, struct context *c,
 		       struct supertype *st);
 extern void RebuildMap(void);
 extern int IncrementalScan(struct context *c, char *devnm);
 extern int IncrementalRemove(char *devname, char *path, int verbose);
+extern int IncrementalQueue(struct mddev_dev *devlist, struct context *c);
+extern int IncrementalDaemon(struct context *c, struct supertype *st);
 extern int CreateBitmap(char *filename, int force, char uuid[16],
 			unsigned long chunksize, unsigned long daemon_sleep,
 			unsigned long write_behind,
 			unsigned long long array_size,
-			int major);
-extern int ExamineBitmap(char *filename, int brief, struct supertype *st);
+			int major, int clean);
+extern int ExamineBitmap(char *filename, int brief, int histogram,
+			 int extents, struct supertype *st);
+extern int BitmapAdvise(char *dev, char *trace, int force, int verbose);
 extern int Write_rules(char *rule_name);
 extern int bitmap_update_uuid(int fd, int *uuid, int swap);
 extern unsigned long bitmap_sectors(struct bitmap_super_s *bsb);
@@ -1301,14 +1369,47 @@ extern int conf_test_dev(char *devname);
 extern int conf_test_metadata(const char *version, struct dev_policy *pol, int is_homehost);
 extern struct createinfo *conf_get_create_info(void);
 extern void set_conffile(char *file);
+extern int conf_changed(void);
+extern void conf_unload(void);
 extern char *conf_get_mailaddr(void);
 extern char *conf_get_mailfrom(void);
 extern char *conf_get_program(void);
 extern char *conf_get_homehost(int *require_homehostp);
 extern char *conf_line(FILE *file);
+/* a dirty region reported by the write-intent bitmap, in sectors */
+struct dirty_extent {
+	unsigned long long start, length;
+};
+extern int read_dirty_extents(char *file, unsigned long long align,
+			      struct dirty_extent **listp);
+/* A list of known bad ranges on a device, in sectors.  Once normalised
+ * it is sorted with no overlapping or adjacent entries.
+ */
+struct md_bb_entry {
+	unsigned long long sector;
+	unsigned long long length;
+};
+struct md_bb {
+	int count, space;
+	struct md_bb_entry *entries;
+};
+extern void md_bb_add(struct md_bb *bb, unsigned long long sector,
+		      unsigned long long length);
+extern void md_bb_normalise(struct md_bb *bb);
+extern int md_bb_find(struct md_bb *bb, unsigned long long sector,
+		      unsigned long long length);
+extern void md_bb_free(struct md_bb *bb);
+extern int md_bb_load_sysfs(char *file, struct md_bb *bb);
 extern char *conf_word(FILE *file, int allow_key);
 extern void print_quoted(char *str);
 extern void print_escape(char *str);
+extern void export_list_start(int json);
+extern void export_list_end(int json);
+extern void export_start(int json, char *dev);
+extern void export_end(void);
+extern void export_value(char *key, char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+extern void export_name(char *key, char *name);
 extern int use_udev(void);
 extern unsigned long GCD(unsigned long a, unsigned long b);
 extern int conf_name_is_free(char *name);
@@ -1449,6 +1550,19 @@ static inline char *to_subarray(struct mdstat_ent *ent, char *container)
 #define dprintf_cont(fmt, arg...) \
         ({ if (0) fprintf(stderr, fmt, ##arg); 0; })
 #endif
+
+/* Static tracepoints in the "mdadm" provider, for systemtap, perf or
+ * bpftrace.  With USE_SDT each is a single nop until a tracer attaches
+ * to it.  Without, they compile to nothing and arguments are not
+ * evaluated, so they must have no side effects.  A *_store_done
+ * probe gives what was written, or a negative error code.
+ */
+#ifdef USE_SDT
+#include <sys/sdt.h>
+#define tracepoint(name, arg...) STAP_PROBEV(mdadm, name, ##arg)
+#else
+#define tracepoint(name, arg...) do {} while (0)
+#endif
 #include <assert.h>
 #include <stdarg.h>
 static inline int xasprintf(char **strp, const char *fmt, ...) {
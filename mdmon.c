@@ -343,6 +343,9 @@ int main(int argc, char *argv[])
 	if (argc - optind > 1)
 		usage();
 
+	if (getenv("MDMON_CLEAN_HOLD"))
+		clean_hold_max = atoi(getenv("MDMON_CLEAN_HOLD"));
+
 	if (strcmp(container_name, "/proc/mdstat") == 0)
 		all = 1;
 
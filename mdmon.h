@@ -25,6 +25,45 @@ enum array_state { clear, inactive, suspended, readonly, read_auto,
 
 enum sync_action { idle, reshape, resync, recover, check, repair, bad_action };
 
+/* per-array counters kept by the monitor */
+struct array_stats {
+	unsigned long dirty;		/* times marked dirty */
+	unsigned long clean;		/* times marked clean */
+	unsigned long held;		/* idle gaps ridden out while dirty */
+	unsigned long md_writes;	/* metadata writes for the above */
+	unsigned long long md_write_us;	/* total time in those writes */
+	unsigned long md_write_max_us;	/* longest of those writes */
+};
+
+/* Timings are counted in buckets of microseconds: bucket 'i' holds
+ * times below 64<<i, the last bucket everything longer.
+ */
+#define MDMON_HIST_BUCKETS 16
+struct mdmon_hist {
+	unsigned long cnt;
+	unsigned long long total_us;
+	unsigned long max_us;
+	unsigned long bucket[MDMON_HIST_BUCKETS];
+};
+
+/* mdmon wide counters, reported by 'mdadm --monitor-stats' */
+struct mdmon_stats {
+	/* monitor wakeups, by reason */
+	unsigned long wake_timeout;
+	unsigned long wake_signal;	/* usually the manager */
+	unsigned long wake_array_state;
+	unsigned long wake_sync_action;
+	unsigned long wake_sync_completed;
+	unsigned long wake_disk_state;
+
+	struct mdmon_hist read_and_act;
+	struct mdmon_hist sync_metadata; /* for state changes and updates */
+	unsigned long updates;		/* metadata updates processed */
+	unsigned long queue_depth;	/* updates waiting for the monitor */
+	unsigned long queue_max;
+	struct mdmon_hist activate_spare;
+};
+
 struct active_array {
 	struct mdinfo info;
 	struct supertype *container;
@@ -49,6 +88,12 @@ struct active_array {
 
 	int check_degraded; /* flag set by mon, read by manage */
 	int check_reshape; /* flag set by mon, read by manage */
+
+	/* dirty/clean hysteresis, see read_and_act() */
+	struct timeval idle_since; /* when active_idle was first seen */
+	struct timeval clean_at; /* when last marked clean */
+	int clean_hold; /* ms to stay dirty once idle */
+	struct array_stats stats;
 };
 
 /*
@@ -84,6 +129,10 @@ struct mdstat_ent *mdstat_read(int hold, int start);
 extern int exit_now, manager_ready;
 extern int mon_tid, mgr_tid;
 extern int monitor_loop_cnt;
+extern int clean_hold_max;
+extern struct mdmon_stats mdmon_stats;
+extern void mdmon_hist_add(struct mdmon_hist *h, struct timeval *start);
+extern char *mdmon_stats_text(struct supertype *container);
 
 /* helper routine to determine resync completion since MaxSector is a
  * moving target
@@ -147,6 +147,7 @@ struct mdstat_ent *mdstat_read(int hold, int start)
 	else
 		fcntl(fileno(f), F_SETFD, FD_CLOEXEC);
 
+	tracepoint(mdstat_read_start, hold);
 	all = NULL;
 	end = &all;
 	for (; (line = conf_line(f)) ; free_line(line)) {
@@ -277,6 +278,7 @@ struct mdstat_ent *mdstat_read(int hold, int start)
 	/* If we might want to start array,
 	 * reverse the order, so that components comes before composites
 	 */
+	tracepoint(mdstat_read_done, all);
 	if (start) {
 		rv = NULL;
 		while (all) {
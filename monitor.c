@@ -222,6 +222,78 @@ static void signal_manager(void)
  *
  */
 
+struct mdmon_stats mdmon_stats;
+
+/* record the time since 'start' in 'h' */
+void mdmon_hist_add(struct mdmon_hist *h, struct timeval *start)
+{
+	struct timeval now;
+	unsigned long us;
+	int i;
+
+	gettimeofday(&now, NULL);
+	us = (now.tv_sec - start->tv_sec) * 1000000 +
+		(now.tv_usec - start->tv_usec);
+	for (i = 0; i < MDMON_HIST_BUCKETS - 1; i++)
+		if (us < (64UL << i))
+			break;
+	h->bucket[i]++;
+	h->cnt++;
+	h->total_us += us;
+	if (us > h->max_us)
+		h->max_us = us;
+}
+
+/* Once the kernel reports 'active_idle' an array is marked clean in
+ * the metadata, and at the next write it is marked dirty again, each
+ * costing a metadata write.  For an array which keeps being written to
+ * shortly after going clean this is wasted effort, so such an array is
+ * held dirty for a while after going idle.  The hold doubles whenever
+ * the array is dirtied again within clean_hold_max ms of going clean
+ * and halves when it stays clean for longer, so arrays with bursty
+ * writes stay dirty and quiet ones are marked clean as before.
+ * clean_hold_max comes from MDMON_CLEAN_HOLD and 0 disables this.
+ */
+int clean_hold_max;
+#define CLEAN_HOLD_MIN 100 /* ms */
+
+static long tv_ms(struct timeval *a, struct timeval *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000 +
+		(a->tv_usec - b->tv_usec) / 1000;
+}
+
+static void note_dirty(struct active_array *a, struct timeval *now)
+{
+	a->stats.dirty++;
+	if (!clean_hold_max || !timerisset(&a->clean_at))
+		return;
+	if (tv_ms(now, &a->clean_at) < clean_hold_max) {
+		a->clean_hold = a->clean_hold ? a->clean_hold * 2
+					      : CLEAN_HOLD_MIN;
+		if (a->clean_hold > clean_hold_max)
+			a->clean_hold = clean_hold_max;
+	} else {
+		a->clean_hold /= 2;
+		if (a->clean_hold < CLEAN_HOLD_MIN)
+			a->clean_hold = 0;
+	}
+}
+
+/* ms until an idle array being held dirty should be marked clean,
+ * or -1 if it is not being held (any more).
+ */
+static long clean_hold_left(struct active_array *a, struct timeval *now)
+{
+	long left;
+
+	if (!clean_hold_max || !a->clean_hold ||
+	    a->curr_state != active_idle || !timerisset(&a->idle_since))
+		return -1;
+	left = a->clean_hold - tv_ms(now, &a->idle_since);
+	return left > 0 ? left : -1;
+}
+
 #define ARRAY_DIRTY 1
 #define ARRAY_BUSY 2
 static int read_and_act(struct active_array *a)
@@ -233,7 +305,8 @@ static int read_and_act(struct active_array *a)
 	struct mdinfo *mdi;
 	int ret = 0;
 	int count = 0;
-	struct timeval tv;
+	int transition = 0;
+	struct timeval tv, tv2;
 
 	a->next_state = bad_word;
 	a->next_action = bad_action;
@@ -277,19 +350,34 @@ static int read_and_act(struct active_array *a)
 		deactivate = 1;
 	}
 	if (a->curr_state == write_pending) {
+		note_dirty(a, &tv);
 		a->container->ss->set_array_state(a, 0);
 		a->next_state = active;
 		ret |= ARRAY_DIRTY;
+		transition = 1;
 	}
 	if (a->curr_state == active_idle) {
 		/* Set array to 'clean' FIRST, then mark clean
-		 * in the metadata
+		 * in the metadata - unless it is being held dirty.
 		 */
-		a->next_state = clean;
+		if (!timerisset(&a->idle_since))
+			a->idle_since = tv;
+		if (sigterm || clean_hold_left(a, &tv) < 0)
+			a->next_state = clean;
 		ret |= ARRAY_DIRTY;
+	} else {
+		if (timerisset(&a->idle_since) && a->clean_hold &&
+		    a->curr_state == active)
+			a->stats.held++;
+		timerclear(&a->idle_since);
 	}
 	if (a->curr_state == clean) {
 		a->container->ss->set_array_state(a, 1);
+		if (a->prev_state != clean) {
+			a->stats.clean++;
+			a->clean_at = tv;
+			transition = 1;
+		}
 	}
 	if (a->curr_state == active ||
 	    a->curr_state == suspended)
@@ -420,7 +508,21 @@ static int read_and_act(struct active_array *a)
 	if (sync_completed > a->last_checkpoint)
 		a->last_checkpoint = sync_completed;
 
+	gettimeofday(&tv2, NULL);
 	a->container->ss->sync_metadata(a->container);
+	if (transition) {
+		struct timeval end;
+		long us;
+
+		gettimeofday(&end, NULL);
+		us = (end.tv_sec - tv2.tv_sec) * 1000000 +
+			(end.tv_usec - tv2.tv_usec);
+		mdmon_hist_add(&mdmon_stats.sync_metadata, &tv2);
+		a->stats.md_writes++;
+		a->stats.md_write_us += us;
+		if ((unsigned long)us > a->stats.md_write_max_us)
+			a->stats.md_write_max_us = us;
+	}
 	dprintf("(%d): state:%s action:%s next(", a->info.container_member,
 		array_states[a->curr_state], sync_actions[a->curr_action]);
 
@@ -546,6 +648,24 @@ static void dprint_wake_reasons(fd_set *fds)
 }
 #endif
 
+static void count_wake_reasons(struct active_array *a, fd_set *fds)
+{
+	struct mdinfo *mdi;
+
+	for (; a; a = a->next) {
+		if (a->info.state_fd >= 0 && FD_ISSET(a->info.state_fd, fds))
+			mdmon_stats.wake_array_state++;
+		if (a->action_fd >= 0 && FD_ISSET(a->action_fd, fds))
+			mdmon_stats.wake_sync_action++;
+		if (a->sync_completed_fd >= 0 &&
+		    FD_ISSET(a->sync_completed_fd, fds))
+			mdmon_stats.wake_sync_completed++;
+		for (mdi = a->info.devs; mdi; mdi = mdi->next)
+			if (mdi->state_fd >= 0 && FD_ISSET(mdi->state_fd, fds))
+				mdmon_stats.wake_disk_state++;
+	}
+}
+
 int monitor_loop_cnt;
 
 static int wait_and_act(struct supertype *container, int nowait)
@@ -557,8 +677,11 @@ static int wait_and_act(struct supertype *container, int nowait)
 	int rv;
 	struct mdinfo *mdi;
 	static unsigned int dirty_arrays = ~0; /* start at some non-zero value */
+	struct timeval now;
+	long hold = -1;
 
 	FD_ZERO(&rfds);
+	gettimeofday(&now, NULL);
 
 	for (ap = aap ; *ap ;) {
 		a = *ap;
@@ -583,6 +706,11 @@ static int wait_and_act(struct supertype *container, int nowait)
 		for (mdi = a->info.devs ; mdi ; mdi = mdi->next)
 			add_fd(&rfds, &maxfd, mdi->state_fd);
 
+		/* wake up to mark a held array clean */
+		if (clean_hold_left(a, &now) > 0 &&
+		    (hold < 0 || clean_hold_left(a, &now) < hold))
+			hold = clean_hold_left(a, &now);
+
 		ap = &(*ap)->next;
 	}
 
@@ -625,37 +753,51 @@ static int wait_and_act(struct supertype *container, int nowait)
 			/* just waiting to get O_EXCL access */
 			ts.tv_sec = 0;
 			ts.tv_nsec = 20000000ULL;
+		} else if (hold >= 0) {
+			ts.tv_sec = hold / 1000;
+			ts.tv_nsec = (hold % 1000) * 1000000;
 		}
 		sigprocmask(SIG_UNBLOCK, NULL, &set);
 		sigdelset(&set, SIGUSR1);
 		monitor_loop_cnt |= 1;
 		rv = pselect(maxfd+1, NULL, NULL, &rfds, &ts, &set);
 		monitor_loop_cnt += 1;
+		tracepoint(monitor_wake, rv);
 		if (rv == -1) {
 			if (errno == EINTR) {
 				rv = 0;
 				dprintf("monitor: caught signal\n");
+				mdmon_stats.wake_signal++;
 			} else
 				dprintf("monitor: error %d in pselect\n",
 					errno);
-		}
-		#ifdef DEBUG
-		else
+		} else if (rv == 0)
+			mdmon_stats.wake_timeout++;
+		else {
+			#ifdef DEBUG
 			dprint_wake_reasons(&rfds);
-		#endif
+			#endif
+			count_wake_reasons(*aap, &rfds);
+		}
 		container->retry_soon = 0;
 	}
 
 	if (update_queue) {
 		struct metadata_update *this;
+		struct timeval start;
 
-		for (this = update_queue; this ; this = this->next)
+		for (this = update_queue; this ; this = this->next) {
+			tracepoint(monitor_update, container->devnm, this->len);
 			container->ss->process_update(container, this);
+			mdmon_stats.updates++;
+		}
 
 		update_queue_handled = update_queue;
 		update_queue = NULL;
 		signal_manager();
+		gettimeofday(&start, NULL);
 		container->ss->sync_metadata(container);
+		mdmon_hist_add(&mdmon_stats.sync_metadata, &start);
 	}
 
 	rv = 0;
@@ -675,7 +817,15 @@ static int wait_and_act(struct supertype *container, int nowait)
 			signal_manager();
 		}
 		if (a->container && !a->to_remove) {
-			int ret = read_and_act(a);
+			struct timeval start;
+			int ret;
+
+			gettimeofday(&start, NULL);
+			tracepoint(monitor_act_start, a->info.sys_name);
+			ret = read_and_act(a);
+			tracepoint(monitor_act_done, a->info.sys_name, ret,
+				   a->curr_state);
+			mdmon_hist_add(&mdmon_stats.read_and_act, &start);
 			rv |= 1;
 			dirty_arrays += !!(ret & ARRAY_DIRTY);
 			/* when terminating stop manipulating the array after it
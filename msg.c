@@ -237,6 +237,33 @@ static char *ping_monitor_version(char *devname)
 	return msg.buf;
 }
 
+/* fetch the statistics text from the mdmon for 'devname'.
+ * An mdmon which does not know the request just acks it, so an
+ * empty reply means it is too old and errno is set to EPROTO.
+ */
+char *mdmon_stats_report(char *devname)
+{
+	struct metadata_update msg = { .len = -2 };
+	int sfd;
+
+	sfd = connect_monitor(devname);
+	if (sfd < 0)
+		return NULL;
+	if (send_message(sfd, &msg, 20) != 0 ||
+	    receive_message(sfd, &msg, 20) != 0) {
+		close(sfd);
+		errno = EIO;
+		return NULL;
+	}
+	close(sfd);
+	if (msg.len <= 0 || !msg.buf) {
+		errno = EPROTO;
+		return NULL;
+	}
+	msg.buf[msg.len - 1] = 0;
+	return msg.buf;
+}
+
 int unblock_subarray(struct mdinfo *sra, const int unfreeze)
 {
 	char buf[64];
@@ -33,5 +33,6 @@ extern void unblock_monitor(char *container, const int unfreeze);
 extern int fping_monitor(int sock);
 extern int ping_manager(char *devname);
 extern void flush_mdmon(char *container);
+extern char *mdmon_stats_report(char *devname);
 
 #define MSG_MAX_LEN (4*1024*1024)
@@ -40,16 +40,11 @@
  * particularly from a set of policy rules in mdadm.conf
  */
 
-static void pol_new(struct dev_policy **pol, char *name, const char *val,
-		    const char *metadata)
+static const char *pol_metadata_name(const char *metadata)
 {
-	struct dev_policy *n = xmalloc(sizeof(*n));
 	const char *real_metadata = NULL;
 	int i;
 
-	n->name = name;
-	n->value = val;
-
 	/* We need to normalise the metadata name */
 	if (metadata) {
 		for (i = 0; superlist[i] ; i++)
@@ -74,12 +69,27 @@ static void pol_new(struct dev_policy **pol, char *name, const char *val,
 			real_metadata = "unknown";
 		}
 	}
+	return real_metadata;
+}
 
-	n->metadata = real_metadata;
+static void pol_new_norm(struct dev_policy **pol, char *name, const char *val,
+			 const char *metadata)
+{
+	struct dev_policy *n = xmalloc(sizeof(*n));
+
+	n->name = name;
+	n->value = val;
+	n->metadata = metadata;
 	n->next = *pol;
 	*pol = n;
 }
 
+static void pol_new(struct dev_policy **pol, char *name, const char *val,
+		    const char *metadata)
+{
+	pol_new_norm(pol, name, val, pol_metadata_name(metadata));
+}
+
 static int pol_lesseq(struct dev_policy *a, struct dev_policy *b)
 {
 	int cmp;
@@ -189,36 +199,112 @@ struct dev_policy *pol_find(struct dev_policy *pol, char *name)
 	return pol;
 }
 
-static char *disk_path(struct mdinfo *disk)
+/*
+ * The same device usually has its policy looked up several times in
+ * one run (for each candidate array in Incremental and try_spare, for
+ * each member in Assemble), so the /dev/disk/by-path names are
+ * collected in one pass over the directory and the merged policy of
+ * each device is remembered.  Both are discarded when the directory
+ * changes, as it does whenever a device comes or goes, and the policy
+ * is also discarded when the rules change.
+ */
+static char by_path_dir[] = "/dev/disk/by-path/";
+static struct by_path_ent {
+	dev_t rdev;
+	char *name;
+} *by_path_tab = NULL;
+static int by_path_cnt = 0;
+static int by_path_loaded = 0;
+static struct timespec by_path_mtime;
+
+#define POL_MEMO_HASH 64
+static struct pol_memo {
+	struct pol_memo *next;
+	dev_t rdev;
+	struct dev_policy *pol;
+} *pol_memo[POL_MEMO_HASH];
+
+static void pol_memo_flush(void)
+{
+	int i;
+
+	for (i = 0; i < POL_MEMO_HASH; i++)
+		while (pol_memo[i]) {
+			struct pol_memo *m = pol_memo[i];
+
+			pol_memo[i] = m->next;
+			dev_policy_free(m->pol);
+			free(m);
+		}
+}
+
+static void by_path_check(void)
 {
 	struct stat stb;
-	int prefix_len;
-	DIR *by_path;
-	char symlink[PATH_MAX] = "/dev/disk/by-path/";
-	char nm[PATH_MAX];
+	struct timespec mt = { 0, 0 };
+
+	if (stat(by_path_dir, &stb) == 0)
+		mt = stb.st_mtim;
+	if (mt.tv_sec == by_path_mtime.tv_sec &&
+	    mt.tv_nsec == by_path_mtime.tv_nsec)
+		return;
+
+	pol_memo_flush();
+	while (by_path_cnt > 0)
+		free(by_path_tab[--by_path_cnt].name);
+	free(by_path_tab);
+	by_path_tab = NULL;
+	by_path_loaded = 0;
+	by_path_mtime = mt;
+}
+
+static void by_path_load(void)
+{
+	char symlink[PATH_MAX];
+	struct stat stb;
 	struct dirent *ent;
-	int rv;
+	DIR *by_path;
+	int alloc = 0;
 
-	by_path = opendir(symlink);
-	if (by_path) {
-		prefix_len = strlen(symlink);
-		while ((ent = readdir(by_path)) != NULL) {
-			if (ent->d_type != DT_LNK)
-				continue;
-			strncpy(symlink + prefix_len,
-					ent->d_name,
-					sizeof(symlink) - prefix_len);
-			if (stat(symlink, &stb) < 0)
-				continue;
-			if ((stb.st_mode & S_IFMT) != S_IFBLK)
-				continue;
-			if (stb.st_rdev != makedev(disk->disk.major, disk->disk.minor))
-				continue;
-			closedir(by_path);
-			return xstrdup(ent->d_name);
+	by_path_loaded = 1;
+	by_path = opendir(by_path_dir);
+	if (!by_path)
+		return;
+	while ((ent = readdir(by_path)) != NULL) {
+		if (ent->d_type != DT_LNK)
+			continue;
+		snprintf(symlink, sizeof(symlink), "%s%s",
+			 by_path_dir, ent->d_name);
+		if (stat(symlink, &stb) < 0)
+			continue;
+		if ((stb.st_mode & S_IFMT) != S_IFBLK)
+			continue;
+		if (by_path_cnt == alloc) {
+			alloc = alloc ? alloc * 2 : 32;
+			by_path_tab = xrealloc(by_path_tab,
+					       alloc * sizeof(by_path_tab[0]));
 		}
-		closedir(by_path);
+		by_path_tab[by_path_cnt].rdev = stb.st_rdev;
+		by_path_tab[by_path_cnt].name = xstrdup(ent->d_name);
+		by_path_cnt++;
 	}
+	closedir(by_path);
+}
+
+static char *disk_path(struct mdinfo *disk)
+{
+	dev_t rdev = makedev(disk->disk.major, disk->disk.minor);
+	char symlink[PATH_MAX];
+	char nm[PATH_MAX];
+	int i, rv;
+
+	if (!by_path_loaded)
+		by_path_load();
+	/* first match in directory order */
+	for (i = 0; i < by_path_cnt; i++)
+		if (by_path_tab[i].rdev == rdev)
+			return xstrdup(by_path_tab[i].name);
+
 	/* A NULL path isn't really acceptable - use the devname.. */
 	sprintf(symlink, "/sys/dev/block/%d:%d", disk->disk.major, disk->disk.minor);
 	rv = readlink(symlink, nm, sizeof(nm)-1);
@@ -246,44 +332,164 @@ static char *disk_type(struct mdinfo *disk)
 		return type_disk;
 }
 
-static int pol_match(struct rule *rule, char *path, char *type)
+/*
+ * The rules are compiled on first use into one index per device
+ * type, so a rule with "type=" is never looked at for the other type.
+ * Each path pattern carries the length of its literal prefix, so most
+ * non-matching paths are rejected by strncmp without calling fnmatch,
+ * and the metadata name is normalised once per rule rather than for
+ * every value merged.
+ */
+enum {
+	POL_DISK,	/* rule_policy rules which can match type=disk */
+	POL_PART,	/* rule_policy rules which can match type=part */
+	POL_OTHER,	/* all rule_policy rules, for any other type */
+	POL_PART_RULE,	/* rule_part rules which can match type=disk */
+	POL_INDEXES
+};
+
+struct pol_compiled {
+	struct pol_compiled *next;
+	struct rule *rule;
+	const char *metadata;	/* normalised */
+	int has_type;
+	int npaths;
+	struct pol_pattern {
+		char *pat;
+		int prefix;	/* length of literal prefix of 'pat' */
+	} paths[];
+};
+
+static struct pol_compiled *pol_compiled = NULL;
+static struct pol_compiled **pol_index[POL_INDEXES];
+static int pol_index_cnt[POL_INDEXES];
+static int pol_compiled_valid = 0;
+
+static void pol_index_add(int idx, struct pol_compiled *pc)
+{
+	pol_index[idx] = xrealloc(pol_index[idx],
+				  (pol_index_cnt[idx] + 1) * sizeof(pc));
+	pol_index[idx][pol_index_cnt[idx]++] = pc;
+}
+
+static struct pol_rule *config_rules = NULL;
+static struct pol_rule **config_rules_end = NULL;
+static int config_rules_has_path = 0;
+
+static void pol_compile(void)
 {
-	/* check if this rule matches on path and type */
-	int pathok = 0; /* 0 == no path, 1 == match, -1 == no match yet */
-	int typeok = 0;
+	struct pol_rule *pr;
 
-	while (rule) {
-		if (rule->name == rule_path) {
-			if (pathok == 0)
-				pathok = -1;
-			if (path && fnmatch(rule->value, path, 0) == 0)
-				pathok = 1;
+	for (pr = config_rules; pr; pr = pr->next) {
+		struct pol_compiled *pc;
+		struct rule *r;
+		char *metadata = NULL;
+		int npaths = 0;
+		int types = 0;
+		int has_type = 0;
+
+		for (r = pr->rule; r; r = r->next) {
+			if (r->name == rule_path)
+				npaths++;
+			else if (r->name == rule_type) {
+				has_type = 1;
+				if (strcmp(r->value, type_disk) == 0)
+					types |= 1 << POL_DISK;
+				else if (strcmp(r->value, type_part) == 0)
+					types |= 1 << POL_PART;
+			} else if (r->name == pol_metadata)
+				metadata = r->value;
 		}
-		if (rule->name == rule_type) {
-			if (typeok == 0)
-				typeok = -1;
-			if (type && strcmp(rule->value, type) == 0)
-				typeok = 1;
+		if (!has_type)
+			types = (1 << POL_DISK) | (1 << POL_PART);
+
+		pc = xcalloc(1, sizeof(*pc) + npaths * sizeof(pc->paths[0]));
+		pc->rule = pr->rule;
+		pc->metadata = pol_metadata_name(metadata);
+		pc->has_type = has_type;
+		for (r = pr->rule; r; r = r->next)
+			if (r->name == rule_path) {
+				struct pol_pattern *pp = &pc->paths[pc->npaths++];
+
+				pp->pat = r->value;
+				pp->prefix = strcspn(r->value, "*?[\\");
+			}
+		pc->next = pol_compiled;
+		pol_compiled = pc;
+
+		if (pr->type == rule_part) {
+			/* part-policy rules are matched against the whole disk */
+			if (types & (1 << POL_DISK))
+				pol_index_add(POL_PART_RULE, pc);
+			continue;
 		}
-		rule = rule->next;
+		if (types & (1 << POL_DISK))
+			pol_index_add(POL_DISK, pc);
+		if (types & (1 << POL_PART))
+			pol_index_add(POL_PART, pc);
+		pol_index_add(POL_OTHER, pc);
+	}
+	pol_compiled_valid = 1;
+}
+
+static void pol_compiled_free(void)
+{
+	int i;
+
+	while (pol_compiled) {
+		struct pol_compiled *pc = pol_compiled;
+
+		pol_compiled = pc->next;
+		free(pc);
+	}
+	for (i = 0; i < POL_INDEXES; i++) {
+		free(pol_index[i]);
+		pol_index[i] = NULL;
+		pol_index_cnt[i] = 0;
 	}
-	return pathok >= 0 && typeok >= 0;
+	pol_compiled_valid = 0;
+	pol_memo_flush();
 }
 
-static void pol_merge(struct dev_policy **pol, struct rule *rule)
+static int pol_match(struct pol_compiled *pc, char *path, char *type)
+{
+	/* check if this rule matches on path, and on type if that wasn't
+	 * already decided by the choice of index.
+	 */
+	struct rule *r;
+	int i;
+
+	if (type) {
+		for (r = pc->rule; r; r = r->next)
+			if (r->name == rule_type && strcmp(r->value, type) == 0)
+				break;
+		if (!r)
+			return 0;
+	}
+	if (pc->npaths == 0)
+		return 1;
+	if (!path)
+		return 0;
+	for (i = 0; i < pc->npaths; i++) {
+		struct pol_pattern *pp = &pc->paths[i];
+
+		if (strncmp(pp->pat, path, pp->prefix) == 0 &&
+		    fnmatch(pp->pat, path, 0) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static void pol_merge(struct dev_policy **pol, struct pol_compiled *pc)
 {
 	/* copy any name assignments from rule into pol */
 	struct rule *r;
-	char *metadata = NULL;
-	for (r = rule; r ; r = r->next)
-		if (r->name == pol_metadata)
-			metadata = r->value;
 
-	for (r = rule; r ; r = r->next)
+	for (r = pc->rule; r ; r = r->next)
 		if (r->name == pol_act ||
 		    r->name == pol_domain ||
 		    r->name == pol_auto)
-			pol_new(pol, r->name, r->value, metadata);
+			pol_new_norm(pol, r->name, r->value, pc->metadata);
 }
 
 static int path_has_part(char *path, char **part)
@@ -300,11 +506,12 @@ static int path_has_part(char *path, char **part)
 		l--;
 	if (l < 5 || strncmp(path+l-5, "-part", 5) != 0)
 		return 0;
-	*part = path+l-4;
+	*part = path+l-5;
 	return 1;
 }
 
-static void pol_merge_part(struct dev_policy **pol, struct rule *rule, char *part)
+static void pol_merge_part(struct dev_policy **pol, struct pol_compiled *pc,
+			   char *part)
 {
 	/* copy any name assignments from rule into pol, appending
 	 * -part to any domain.  The string with -part appended is
@@ -312,14 +519,10 @@ static void pol_merge_part(struct dev_policy **pol, struct rule *rule, char *par
 	 * the rule.
 	 */
 	struct rule *r;
-	char *metadata = NULL;
-	for (r = rule; r ; r = r->next)
-		if (r->name == pol_metadata)
-			metadata = r->value;
 
-	for (r = rule; r ; r = r->next) {
+	for (r = pc->rule; r ; r = r->next) {
 		if (r->name == pol_act)
-			pol_new(pol, r->name, r->value, metadata);
+			pol_new_norm(pol, r->name, r->value, pc->metadata);
 		else if (r->name == pol_domain) {
 			char *dom;
 			int len;
@@ -337,15 +540,11 @@ static void pol_merge_part(struct dev_policy **pol, struct rule *rule, char *par
 				dl_add(r->dups, newdom);
 				dom = newdom;
 			}
-			pol_new(pol, r->name, dom, metadata);
+			pol_new_norm(pol, r->name, dom, pc->metadata);
 		}
 	}
 }
 
-static struct pol_rule *config_rules = NULL;
-static struct pol_rule **config_rules_end = NULL;
-static int config_rules_has_path = 0;
-
 /*
  * most policy comes from a set policy rules that are
  * read from the config file.
@@ -354,25 +553,36 @@ static int config_rules_has_path = 0;
  */
 struct dev_policy *path_policy(char *path, char *type)
 {
-	struct pol_rule *rules;
 	struct dev_policy *pol = NULL;
-	int i;
+	char *part;
+	int idx, i;
 
-	rules = config_rules;
-
-	while (rules) {
-		char *part;
-		if (rules->type == rule_policy)
-			if (pol_match(rules->rule, path, type))
-				pol_merge(&pol, rules->rule);
-		if (rules->type == rule_part && strcmp(type, type_part) == 0)
-			if (path_has_part(path, &part)) {
-				*part = 0;
-				if (pol_match(rules->rule, path, type_disk))
-					pol_merge_part(&pol, rules->rule, part+1);
-				*part = '-';
-			}
-		rules = rules->next;
+	if (!pol_compiled_valid)
+		pol_compile();
+
+	if (type && strcmp(type, type_disk) == 0)
+		idx = POL_DISK;
+	else if (type && strcmp(type, type_part) == 0)
+		idx = POL_PART;
+	else
+		idx = POL_OTHER;
+
+	for (i = 0; i < pol_index_cnt[idx]; i++) {
+		struct pol_compiled *pc = pol_index[idx][i];
+
+		if (pol_match(pc, path,
+			      (idx == POL_OTHER && pc->has_type) ? type : NULL))
+			pol_merge(&pol, pc);
+	}
+	if (idx == POL_PART && path_has_part(path, &part)) {
+		*part = 0;
+		for (i = 0; i < pol_index_cnt[POL_PART_RULE]; i++) {
+			struct pol_compiled *pc = pol_index[POL_PART_RULE][i];
+
+			if (pol_match(pc, path, NULL))
+				pol_merge_part(&pol, pc, part+1);
+		}
+		*part = '-';
 	}
 
 	/* Now add any metadata-specific internal knowledge
@@ -400,23 +610,49 @@ void pol_add(struct dev_policy **pol,
 	pol_dedup(*pol);
 }
 
+static struct dev_policy *pol_dup(struct dev_policy *pol)
+{
+	struct dev_policy *new = NULL, **np = &new;
+
+	for (; pol; pol = pol->next) {
+		*np = xmalloc(sizeof(**np));
+		**np = *pol;
+		np = &(*np)->next;
+	}
+	*np = NULL;
+	return new;
+}
+
 /*
  * disk_policy() gathers policy information for the
  * disk described in the given mdinfo (disk.{major,minor}).
+ * The caller gets its own copy of the list, to free with
+ * dev_policy_free().
  */
 struct dev_policy *disk_policy(struct mdinfo *disk)
 {
+	dev_t rdev = makedev(disk->disk.major, disk->disk.minor);
+	struct pol_memo *m;
 	char *path = NULL;
-	char *type = disk_type(disk);
-	struct dev_policy *pol = NULL;
+	char *type;
+
+	by_path_check();
+	for (m = pol_memo[rdev % POL_MEMO_HASH]; m; m = m->next)
+		if (m->rdev == rdev)
+			return pol_dup(m->pol);
 
+	type = disk_type(disk);
 	if (config_rules_has_path)
 		path = disk_path(disk);
 
-	pol = path_policy(path, type);
+	m = xmalloc(sizeof(*m));
+	m->rdev = rdev;
+	m->pol = path_policy(path, type);
+	m->next = pol_memo[rdev % POL_MEMO_HASH];
+	pol_memo[rdev % POL_MEMO_HASH] = m;
 
 	free(path);
-	return pol;
+	return pol_dup(m->pol);
 }
 
 struct dev_policy *devid_policy(int dev)
@@ -482,6 +718,7 @@ void policyline(char *line, char *type)
 	}
 	pr->next = config_rules;
 	config_rules = pr;
+	pol_compiled_free();
 }
 
 void policy_add(char *type, ...)
@@ -509,10 +746,12 @@ void policy_add(char *type, ...)
 	pr->next = config_rules;
 	config_rules = pr;
 	va_end(ap);
+	pol_compiled_free();
 }
 
 void policy_free(void)
 {
+	pol_compiled_free();
 	while (config_rules) {
 		struct pol_rule *pr = config_rules;
 		struct rule *r;
@@ -322,6 +322,7 @@ int manual_repair(int diskP, int diskQ, int chunk_size, int raid_disks, int data
 int check_stripes(struct mdinfo *info, int *source, unsigned long long *offsets,
 		  int raid_disks, int chunk_size, int level, int layout,
 		  unsigned long long start, unsigned long long length, char *name[],
+		  struct md_bb *bbs,
 		  enum repair repair, int failed_disk1, int failed_disk2)
 {
 	/* read the data and p and q blocks, and check we got them right */
@@ -351,6 +352,22 @@ int check_stripes(struct mdinfo *info, int *source, unsigned long long *offsets,
 	while (length > 0) {
 		int disk[chunk_size >> CHECK_PAGE_BITS];
 
+		/* Known bad blocks would just fail the read, so skip
+		 * such stripes and say why.
+		 */
+		for (i = 0; bbs && i < raid_disks; i++)
+			if (md_bb_find(&bbs[i],
+				       (offsets[i] + start * chunk_size) >> 9,
+				       chunk_size >> 9) >= 0)
+				break;
+		if (bbs && i < raid_disks) {
+			printf("Skipping stripe %llu: known bad blocks on disk slot %d --> %s\n",
+			       start, i, name[i]);
+			length--;
+			start++;
+			continue;
+		}
+
 		err = lock_stripe(info, start, chunk_size, data_disks, sig);
 		if(err != 0) {
 			if (err != 2)
@@ -482,6 +499,9 @@ int main(int argc, char *argv[])
 	int mdfd;
 	struct mdinfo *info = NULL, *comp = NULL;
 	char *err = NULL;
+	char *dirty_list = NULL;
+	struct dirty_extent *ext = NULL;
+	struct md_bb *bbs = NULL;
 	int exit_err = 0;
 	int close_flag = 0;
 	char *prg = strrchr(argv[0], '/');
@@ -494,6 +514,7 @@ int main(int argc, char *argv[])
 	if (argc < 4) {
 		fprintf(stderr, "Usage: %s md_device start_stripe length_stripes [autorepair]\n", prg);
 		fprintf(stderr, "   or: %s md_device repair stripe failed_slot_1 failed_slot_2\n", prg);
+		fprintf(stderr, "   or: %s md_device dirty extent_list [autorepair]\n", prg);
 		exit_err = 1;
 		goto exitHere;
 	}
@@ -587,6 +608,14 @@ int main(int argc, char *argv[])
 			goto exitHere;
 		}
 	}
+	else if (strcmp(argv[2], "dirty")==0) {
+		/* extent list from mdadm --examine-bitmap --dirty-extents */
+		dirty_list = argv[3];
+		start = 0;
+		length = 0;
+		if (argc >= 5 && strcmp(argv[4], "autorepair")==0)
+			repair = AUTO_REPAIR;
+	}
 	else {
 		start = getnum(argv[2], &err);
 		length = getnum(argv[3], &err);
@@ -613,6 +642,7 @@ int main(int argc, char *argv[])
 	disk_name = xmalloc(raid_disks * sizeof(*disk_name));
 	fds = xmalloc(raid_disks * sizeof(*fds));
 	offsets = xcalloc(raid_disks, sizeof(*offsets));
+	bbs = xcalloc(raid_disks, sizeof(*bbs));
 	buf = xmalloc(raid_disks * chunk_size);
 
 	for(i=0; i<raid_disks; i++) {
@@ -622,10 +652,14 @@ int main(int argc, char *argv[])
 
 	comp = info->devs;
 	for (i=0, active_disks=0; active_disks<raid_disks; i++) {
+		char bbfile[100];
 		int disk_slot = comp->disk.raid_disk;
 		if(disk_slot >= 0) {
 			disk_name[disk_slot] = map_dev(comp->disk.major, comp->disk.minor, 0);
 			offsets[disk_slot] = comp->data_offset * 512;
+			sprintf(bbfile, "/sys/block/%s/md/%s/bad_blocks",
+				info->sys_name, comp->sys_name);
+			md_bb_load_sysfs(bbfile, &bbs[disk_slot]);
 			fds[disk_slot] = open(disk_name[disk_slot], O_RDWR | O_SYNC);
 			if (fds[disk_slot] < 0) {
 				perror(disk_name[disk_slot]);
@@ -638,9 +672,37 @@ int main(int argc, char *argv[])
 		comp = comp->next;
 	}
 
-	int rv = check_stripes(info, fds, offsets,
-			       raid_disks, chunk_size, level, layout,
-			       start, length, disk_name, repair, failed_disk1, failed_disk2);
+	int rv = 0;
+	if (dirty_list) {
+		/* The bitmap covers the component devices, so the
+		 * sectors in the list map directly on to stripes.
+		 */
+		unsigned long long stripes = (info->component_size * 512) / chunk_size;
+		int n = read_dirty_extents(dirty_list, chunk_size / 512, &ext);
+
+		if (n < 0) {
+			exit_err = 4;
+			goto exitHere;
+		}
+		for (i = 0; i < n && rv == 0; i++) {
+			start = ext[i].start * 512 / chunk_size;
+			length = ext[i].length * 512 / chunk_size;
+			if (start >= stripes)
+				break;
+			if (start + length > stripes)
+				length = stripes - start;
+			printf("checking stripes %llu-%llu\n",
+			       start, start + length - 1);
+			rv = check_stripes(info, fds, offsets,
+					   raid_disks, chunk_size, level, layout,
+					   start, length, disk_name, bbs, repair,
+					   failed_disk1, failed_disk2);
+		}
+	} else
+		rv = check_stripes(info, fds, offsets,
+				   raid_disks, chunk_size, level, layout,
+				   start, length, disk_name, bbs, repair,
+				   failed_disk1, failed_disk2);
 	if (rv != 0) {
 		fprintf(stderr,	"%s: check_stripes returned %d\n", prg, rv);
 		exit_err = 7;
@@ -657,6 +719,11 @@ exitHere:
 	free(fds);
 	free(offsets);
 	free(buf);
+	free(ext);
+	if (bbs)
+		for (i = 0; i < raid_disks; i++)
+			md_bb_free(&bbs[i]);
+	free(bbs);
 
 	exit(exit_err);
 }
@@ -488,6 +488,11 @@ struct ddf_super {
 				int pdnum;	/* index in ->phys */
 				struct spare_assign *spare;
 				void *mdupdate; /* hold metadata update */
+				/* sections as last written to both
+				 * headers, see _write_super_to_disk() */
+				void *written;
+				unsigned int written_size; /* allocated */
+				unsigned int written_len; /* valid, or 0 */
 
 				/* These fields used by auto-layout */
 				int raiddisk; /* slot to fill in autolayout */
@@ -498,6 +503,7 @@ struct ddf_super {
 		struct disk_data disk;
 		struct vcl *vlist[0]; /* max_part in size */
 	} *dlist, *add_list;
+	struct ddf_index	*index; /* see find_phys() */
 };
 
 #ifndef MDASSEMBLE
@@ -521,6 +527,7 @@ static int validate_geometry_ddf_bvd(struct supertype *st,
 #endif
 
 static void free_super_ddf(struct supertype *st);
+static void ddf_drop_index(struct ddf_super *ddf);
 static int all_ff(const char *guid);
 static unsigned int get_pd_index_from_refnum(const struct vcl *vc,
 					     be32 refnum, unsigned int nmax,
@@ -804,7 +811,157 @@ good:
 	return 0;
 }
 
-static int load_ddf_header(int fd, unsigned long long lba,
+/* The DDF structures on a device are the anchor in the last sector,
+ * and a primary and a secondary header each followed by the sections
+ * at offsets given in the (identical) headers.  Rather than seeking
+ * and reading each of these in turn, the anchor and then everything
+ * from each header to the end of the last section we use are read in
+ * one go, for all devices of a container at once, and parsed from
+ * memory.  Anything not covered (odd layouts, failed reads) is read
+ * directly from the device as before.
+ */
+#define DDF_AREA_MAX 4096 /* sectors read in one go from each header */
+struct ddf_area {
+	int fd;
+	unsigned long long dsize;	/* bytes */
+	void *anchor;			/* last sector, NULL if not read */
+	int anchor_err;
+	unsigned long long lba[2];	/* primary, secondary header */
+	unsigned long long sectors[2];	/* read from each into buf[] */
+	void *buf[2];
+};
+
+static void ddf_area_init(struct ddf_area *a, int fd)
+{
+	memset(a, 0, sizeof(*a));
+	a->fd = fd;
+}
+
+static void ddf_area_free(struct ddf_area *a)
+{
+	free(a->anchor);
+	free(a->buf[0]);
+	free(a->buf[1]);
+	a->anchor = a->buf[0] = a->buf[1] = NULL;
+}
+
+/* sectors from a header to the end of the last section we load */
+static unsigned long long ddf_area_extent(struct ddf_header *h)
+{
+	be32 sect[5][2] = {
+		{ h->controller_section_offset, h->controller_section_length },
+		{ h->phys_section_offset, h->phys_section_length },
+		{ h->virt_section_offset, h->virt_section_length },
+		{ h->config_section_offset, h->config_section_length },
+		{ h->data_section_offset, h->data_section_length },
+	};
+	unsigned long long end = 1;
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		unsigned long long e = (unsigned long long)
+			be32_to_cpu(sect[i][0]) + be32_to_cpu(sect[i][1]);
+
+		if (be32_to_cpu(sect[i][0]) != 0xffffffff && e > end)
+			end = e;
+	}
+	return end;
+}
+
+static void ddf_area_read(struct ddf_area *a, int cnt)
+{
+	struct md_io *io = xcalloc(cnt * 2, sizeof(*io));
+	int i, c, n;
+
+	/* first the anchors */
+	for (i = 0, n = 0; i < cnt; i++) {
+		if (!get_dev_size(a[i].fd, NULL, &a[i].dsize) ||
+		    a[i].dsize < 1024 ||
+		    posix_memalign(&a[i].anchor, 512, 512) != 0) {
+			a[i].anchor = NULL;
+			a[i].anchor_err = EINVAL;
+			continue;
+		}
+		io[n].fd = a[i].fd;
+		io[n].buf = a[i].anchor;
+		io[n].len = 512;
+		io[n].offset = a[i].dsize - 512;
+		n++;
+	}
+	md_io_batch(io, n);
+	for (i = 0, n = 0; i < cnt; i++) {
+		if (!a[i].anchor)
+			continue;
+		if (io[n].rv != 512) {
+			a[i].anchor_err = io[n].rv < 0 ? -io[n].rv : EIO;
+			free(a[i].anchor);
+			a[i].anchor = NULL;
+		}
+		n++;
+	}
+
+	/* then everything the headers lead to */
+	for (i = 0, n = 0; i < cnt; i++) {
+		struct ddf_header *anchor = a[i].anchor;
+		unsigned long long size = a[i].dsize >> 9;
+		unsigned long long extent;
+
+		if (!anchor || !be32_eq(anchor->magic, DDF_HEADER_MAGIC))
+			continue;
+		extent = ddf_area_extent(anchor);
+		if (extent > DDF_AREA_MAX)
+			continue;
+		a[i].lba[0] = be64_to_cpu(anchor->primary_lba);
+		a[i].lba[1] = be64_to_cpu(anchor->secondary_lba);
+		for (c = 0; c < 2; c++) {
+			if (a[i].lba[c] >= size - 1)
+				continue;
+			a[i].sectors[c] = extent;
+			if (a[i].lba[c] + extent > size - 1)
+				a[i].sectors[c] = size - 1 - a[i].lba[c];
+			if (posix_memalign(&a[i].buf[c], 4096,
+					   a[i].sectors[c] << 9) != 0) {
+				a[i].buf[c] = NULL;
+				continue;
+			}
+			io[n].fd = a[i].fd;
+			io[n].buf = a[i].buf[c];
+			io[n].len = a[i].sectors[c] << 9;
+			io[n].offset = a[i].lba[c] << 9;
+			n++;
+		}
+	}
+	md_io_batch(io, n);
+	for (i = 0, n = 0; i < cnt; i++)
+		for (c = 0; c < 2; c++) {
+			if (!a[i].buf[c])
+				continue;
+			if (io[n].rv != (long long)io[n].len) {
+				free(a[i].buf[c]);
+				a[i].buf[c] = NULL;
+			}
+			n++;
+		}
+	free(io);
+}
+
+/* copy 'len' sectors at 'lba' from the area if it was read */
+static int ddf_area_get(struct ddf_area *a, void *buf,
+			unsigned long long lba, unsigned long long len)
+{
+	int c;
+
+	for (c = 0; c < 2; c++)
+		if (a->buf[c] && lba >= a->lba[c] &&
+		    lba + len <= a->lba[c] + a->sectors[c]) {
+			memcpy(buf, a->buf[c] + ((lba - a->lba[c]) << 9),
+			       len << 9);
+			return 1;
+		}
+	return 0;
+}
+
+static int load_ddf_header(struct ddf_area *area, unsigned long long lba,
 			   unsigned long long size,
 			   int type,
 			   struct ddf_header *hdr, struct ddf_header *anchor)
@@ -815,14 +972,18 @@ static int load_ddf_header(int fd, unsigned long long lba,
 	 *   magic, crc, guid, rev, and LBA's header_type, and
 	 *  everything after header_type must be the same
 	 */
+	int fd = area->fd;
+
 	if (lba >= size-1)
 		return 0;
 
-	if (lseek64(fd, lba<<9, 0) < 0)
-		return 0;
+	if (!ddf_area_get(area, hdr, lba, 1)) {
+		if (lseek64(fd, lba<<9, 0) < 0)
+			return 0;
 
-	if (read(fd, hdr, 512) != 512)
-		return 0;
+		if (read(fd, hdr, 512) != 512)
+			return 0;
+	}
 
 	if (!be32_eq(hdr->magic, DDF_HEADER_MAGIC)) {
 		pr_err("bad header magic\n");
@@ -847,9 +1008,10 @@ static int load_ddf_header(int fd, unsigned long long lba,
 	return 1;
 }
 
-static void *load_section(int fd, struct ddf_super *super, void *buf,
-			  be32 offset_be, be32 len_be, int check)
+static void *load_section(struct ddf_area *area, struct ddf_super *super,
+			  void *buf, be32 offset_be, be32 len_be, int check)
 {
+	int fd = area->fd;
 	unsigned long long offset = be32_to_cpu(offset_be);
 	unsigned long long len = be32_to_cpu(len_be);
 	int dofree = (buf == NULL);
@@ -872,6 +1034,8 @@ static void *load_section(int fd, struct ddf_super *super, void *buf,
 	else
 		offset += be64_to_cpu(super->active->secondary_lba);
 
+	if (ddf_area_get(area, buf, offset, len))
+		return buf;
 	if ((unsigned long long)lseek64(fd, offset<<9, 0) != (offset<<9)) {
 		if (dofree)
 			free(buf);
@@ -885,24 +1049,18 @@ static void *load_section(int fd, struct ddf_super *super, void *buf,
 	return buf;
 }
 
-static int load_ddf_headers(int fd, struct ddf_super *super, char *devname)
+static int load_ddf_headers(struct ddf_area *area, struct ddf_super *super,
+			    char *devname)
 {
-	unsigned long long dsize;
+	unsigned long long dsize = area->dsize;
 
-	get_dev_size(fd, NULL, &dsize);
-
-	if (lseek64(fd, dsize-512, 0) < 0) {
-		if (devname)
-			pr_err("Cannot seek to anchor block on %s: %s\n",
-			       devname, strerror(errno));
-		return 1;
-	}
-	if (read(fd, &super->anchor, 512) != 512) {
+	if (!area->anchor) {
 		if (devname)
 			pr_err("Cannot read anchor block on %s: %s\n",
-			       devname, strerror(errno));
+			       devname, strerror(area->anchor_err));
 		return 1;
 	}
+	memcpy(&super->anchor, area->anchor, 512);
 	if (!be32_eq(super->anchor.magic, DDF_HEADER_MAGIC)) {
 		if (devname)
 			pr_err("no DDF anchor found on %s\n",
@@ -923,7 +1081,7 @@ static int load_ddf_headers(int fd, struct ddf_super *super, char *devname)
 		return 2;
 	}
 	super->active = NULL;
-	if (load_ddf_header(fd, be64_to_cpu(super->anchor.primary_lba),
+	if (load_ddf_header(area, be64_to_cpu(super->anchor.primary_lba),
 			    dsize >> 9,  1,
 			    &super->primary, &super->anchor) == 0) {
 		if (devname)
@@ -931,7 +1089,7 @@ static int load_ddf_headers(int fd, struct ddf_super *super, char *devname)
 	} else
 		super->active = &super->primary;
 
-	if (load_ddf_header(fd, be64_to_cpu(super->anchor.secondary_lba),
+	if (load_ddf_header(area, be64_to_cpu(super->anchor.secondary_lba),
 			    dsize >> 9,  2,
 			    &super->secondary, &super->anchor)) {
 		if (super->active == NULL
@@ -952,20 +1110,21 @@ static int load_ddf_headers(int fd, struct ddf_super *super, char *devname)
 	return 0;
 }
 
-static int load_ddf_global(int fd, struct ddf_super *super, char *devname)
+static int load_ddf_global(struct ddf_area *area, struct ddf_super *super,
+			   char *devname)
 {
 	void *ok;
-	ok = load_section(fd, super, &super->controller,
+	ok = load_section(area, super, &super->controller,
 			  super->active->controller_section_offset,
 			  super->active->controller_section_length,
 			  0);
-	super->phys = load_section(fd, super, NULL,
+	super->phys = load_section(area, super, NULL,
 				   super->active->phys_section_offset,
 				   super->active->phys_section_length,
 				   1);
 	super->pdsize = be32_to_cpu(super->active->phys_section_length) * 512;
 
-	super->virt = load_section(fd, super, NULL,
+	super->virt = load_section(area, super, NULL,
 				   super->active->virt_section_offset,
 				   super->active->virt_section_length,
 				   1);
@@ -1036,9 +1195,32 @@ static void add_other_bvd(struct vcl *vcl, struct vd_config *vd,
 	memcpy(vcl->other_bvds[i], vd, len);
 }
 
-static int load_ddf_local(int fd, struct ddf_super *super,
+/* Size of the copy of the sections written to a disk's headers, see
+ * ddf_note_written().
+ */
+static unsigned int ddf_written_size(const struct ddf_super *ddf)
+{
+	return 512 + ddf->pdsize + ddf->vdsize +
+		ddf->conf_rec_len * 512 * (ddf->max_part + 1) + 512;
+}
+
+/* The copy is allocated with the 'struct dl' rather than when it is
+ * filled in, as mdmon's monitor thread writes the metadata and must not
+ * allocate.  Without it every write is just done in full.
+ */
+static void ddf_alloc_written(const struct ddf_super *ddf, struct dl *dl)
+{
+	dl->written_size = ddf_written_size(ddf);
+	dl->written_len = 0;
+	dl->written = malloc(dl->written_size);
+	if (!dl->written)
+		dl->written_size = 0;
+}
+
+static int load_ddf_local(struct ddf_area *area, struct ddf_super *super,
 			  char *devname, int keep)
 {
+	int fd = area->fd;
 	struct dl *dl;
 	struct stat stb;
 	char *conf;
@@ -1057,7 +1239,7 @@ static int load_ddf_local(int fd, struct ddf_super *super,
 		return 1;
 	}
 
-	load_section(fd, super, &dl->disk,
+	load_section(area, super, &dl->disk,
 		     super->active->data_section_offset,
 		     super->active->data_section_length,
 		     0);
@@ -1068,6 +1250,7 @@ static int load_ddf_local(int fd, struct ddf_super *super,
 	dl->minor = minor(stb.st_rdev);
 	dl->next = super->dlist;
 	dl->fd = keep ? fd : -1;
+	ddf_alloc_written(super, dl);
 
 	dl->size = 0;
 	if (get_dev_size(fd, devname, &dsize))
@@ -1095,7 +1278,7 @@ static int load_ddf_local(int fd, struct ddf_super *super,
 	 * the conflist
 	 */
 
-	conf = load_section(fd, super, super->conf,
+	conf = load_section(area, super, super->conf,
 			    super->active->config_section_offset,
 			    super->active->config_section_length,
 			    0);
@@ -1175,6 +1358,7 @@ static int load_super_ddf(struct supertype *st, int fd,
 {
 	unsigned long long dsize;
 	struct ddf_super *super;
+	struct ddf_area area;
 	int rv;
 
 	if (get_dev_size(fd, devname, &dsize) == 0)
@@ -1207,24 +1391,34 @@ static int load_super_ddf(struct supertype *st, int fd,
 	}
 	memset(super, 0, sizeof(*super));
 
-	rv = load_ddf_headers(fd, super, devname);
+	tracepoint(super_load_start, "ddf", fd, 0);
+	ddf_area_init(&area, fd);
+	ddf_area_read(&area, 1);
+
+	rv = load_ddf_headers(&area, super, devname);
 	if (rv) {
+		tracepoint(super_load_done, "ddf", fd, rv);
+		ddf_area_free(&area);
 		free(super);
 		return rv;
 	}
 
 	/* Have valid headers and have chosen the best. Let's read in the rest*/
 
-	rv = load_ddf_global(fd, super, devname);
+	rv = load_ddf_global(&area, super, devname);
 
 	if (rv) {
+		tracepoint(super_load_done, "ddf", fd, rv);
 		if (devname)
 			pr_err("Failed to load all information sections on %s\n", devname);
+		ddf_area_free(&area);
 		free(super);
 		return rv;
 	}
 
-	rv = load_ddf_local(fd, super, devname, 0);
+	rv = load_ddf_local(&area, super, devname, 0);
+	ddf_area_free(&area);
+	tracepoint(super_load_done, "ddf", fd, rv);
 
 	if (rv) {
 		if (devname)
@@ -1250,6 +1444,7 @@ static void free_super_ddf(struct supertype *st)
 	struct ddf_super *ddf = st->sb;
 	if (ddf == NULL)
 		return;
+	ddf_drop_index(ddf);
 	free(ddf->phys);
 	free(ddf->virt);
 	free(ddf->conf);
@@ -1273,6 +1468,7 @@ static void free_super_ddf(struct supertype *st)
 			close(d->fd);
 		if (d->spare)
 			free(d->spare);
+		free(d->written);
 		free(d);
 	}
 	while (ddf->add_list) {
@@ -1282,6 +1478,7 @@ static void free_super_ddf(struct supertype *st)
 			close(d->fd);
 		if (d->spare)
 			free(d->spare);
+		free(d->written);
 		free(d);
 	}
 	free(ddf);
@@ -1833,6 +2030,124 @@ static int match_home_ddf(struct supertype *st, char *homehost)
 		ddf->controller.vendor_data[len] == 0);
 }
 
+/* Physical disk entries are indexed by refnum, virtual disk entries by
+ * guid and configurations by vcnum.  Entries change in many places as
+ * updates are applied, so every hit is checked against the table it
+ * points into, and a lookup that misses falls back to a scan and
+ * rebuilds the indexes if the scan succeeds.  Both mdmon threads look
+ * things up, so the indexes are only allocated when a container is
+ * loaded, are refilled in place, and are freed with the ddf_super.
+ * Without them (e.g. a single device loaded by mdadm) lookups scan.
+ */
+struct ddf_index {
+	unsigned int pd_size, vd_size, vc_size; /* pd and vd a power of 2 */
+	unsigned int *pd;	/* refnum hash -> phys entry + 1 */
+	unsigned int *vd;	/* guid hash -> virt entry + 1 */
+	struct vcl **vc;	/* vcnum -> vcl */
+};
+
+static unsigned int refnum_hash(be32 refnum)
+{
+	return be32_to_cpu(refnum) * 2654435761U;
+}
+
+static unsigned int guid_hash(const char *guid)
+{
+	unsigned int h = 2166136261U;
+	int i;
+
+	for (i = 0; i < DDF_GUID_LEN; i++)
+		h = (h ^ (unsigned char)guid[i]) * 16777619U;
+	return h;
+}
+
+static void ddf_drop_index(struct ddf_super *ddf)
+{
+	if (!ddf->index)
+		return;
+	free(ddf->index->pd);
+	free(ddf->index->vd);
+	free(ddf->index->vc);
+	free(ddf->index);
+	ddf->index = NULL;
+}
+
+static void ddf_build_index(const struct ddf_super *cddf)
+{
+	struct ddf_super *ddf = (struct ddf_super *)cddf;
+	struct ddf_index *ix = ddf->index;
+	unsigned int max_pdes, max_vdes, i, h;
+	struct vcl *v;
+
+	if (!ix || !ddf->phys || !ddf->virt)
+		return;
+	max_pdes = be16_to_cpu(ddf->phys->max_pdes);
+	max_vdes = be16_to_cpu(ddf->virt->max_vdes);
+	memset(ix->pd, 0, ix->pd_size * sizeof(*ix->pd));
+	memset(ix->vd, 0, ix->vd_size * sizeof(*ix->vd));
+	memset(ix->vc, 0, ix->vc_size * sizeof(*ix->vc));
+	/* the tables never grow, but if they did, leave the rest to scans */
+	if (max_pdes * 2 > ix->pd_size)
+		max_pdes = ix->pd_size / 2;
+	if (max_vdes * 2 > ix->vd_size)
+		max_vdes = ix->vd_size / 2;
+
+	/* the first of any duplicates wins, as in a scan */
+	for (i = 0; i < max_pdes; i++) {
+		be32 refnum = ddf->phys->entries[i].refnum;
+
+		if (be32_to_cpu(refnum) == 0xffffffff)
+			continue;
+		h = refnum_hash(refnum) & (ix->pd_size - 1);
+		while (ix->pd[h] &&
+		       !be32_eq(ddf->phys->entries[ix->pd[h]-1].refnum, refnum))
+			h = (h + 1) & (ix->pd_size - 1);
+		if (!ix->pd[h])
+			ix->pd[h] = i + 1;
+	}
+	for (i = 0; i < max_vdes; i++) {
+		const char *guid = ddf->virt->entries[i].guid;
+
+		if (all_ff(guid))
+			continue;
+		h = guid_hash(guid) & (ix->vd_size - 1);
+		while (ix->vd[h] &&
+		       memcmp(ddf->virt->entries[ix->vd[h]-1].guid, guid,
+			      DDF_GUID_LEN) != 0)
+			h = (h + 1) & (ix->vd_size - 1);
+		if (!ix->vd[h])
+			ix->vd[h] = i + 1;
+	}
+	for (v = ddf->conflist; v; v = v->next)
+		if (v->vcnum < ix->vc_size && !ix->vc[v->vcnum])
+			ix->vc[v->vcnum] = v;
+}
+
+/* Called once the container is loaded, before any other thread
+ * can see it.
+ */
+static void ddf_alloc_index(struct ddf_super *ddf)
+{
+	struct ddf_index *ix;
+	unsigned int max_pdes, max_vdes;
+
+	if (ddf->index || !ddf->phys || !ddf->virt)
+		return;
+	max_pdes = be16_to_cpu(ddf->phys->max_pdes);
+	max_vdes = be16_to_cpu(ddf->virt->max_vdes);
+	ix = xcalloc(1, sizeof(*ix));
+	for (ix->pd_size = 16; ix->pd_size < max_pdes * 2; )
+		ix->pd_size *= 2;
+	for (ix->vd_size = 16; ix->vd_size < max_vdes * 2; )
+		ix->vd_size *= 2;
+	ix->vc_size = max_vdes;
+	ix->pd = xcalloc(ix->pd_size, sizeof(*ix->pd));
+	ix->vd = xcalloc(ix->vd_size, sizeof(*ix->vd));
+	ix->vc = xcalloc(ix->vc_size, sizeof(*ix->vc));
+	ddf->index = ix;
+	ddf_build_index(ddf);
+}
+
 #ifndef MDASSEMBLE
 static int find_index_in_bvd(const struct ddf_super *ddf,
 			     const struct vd_config *conf, unsigned int n,
@@ -1871,9 +2186,19 @@ static struct vd_config *find_vdcr(struct ddf_super *ddf, unsigned int inst,
 				   unsigned int n,
 				   unsigned int *n_bvd, struct vcl **vcl)
 {
-	struct vcl *v;
+	struct vcl *v = NULL;
+
+	if (ddf->index && inst < ddf->index->vc_size)
+		v = ddf->index->vc[inst];
+	if (!v || v->vcnum != inst) {
+		for (v = ddf->conflist; v; v = v->next)
+			if (v->vcnum == inst)
+				break;
+		if (v)
+			ddf_build_index(ddf);
+	}
 
-	for (v = ddf->conflist; v; v = v->next) {
+	for (; v; v = v->next) {
 		unsigned int nsec, ibvd = 0;
 		struct vd_config *conf;
 		if (inst != v->vcnum)
@@ -1922,9 +2247,25 @@ static int find_phys(const struct ddf_super *ddf, be32 phys_refnum)
 	 * and return it's index
 	 */
 	unsigned int i;
-	for (i = 0; i < be16_to_cpu(ddf->phys->max_pdes); i++)
-		if (be32_eq(ddf->phys->entries[i].refnum, phys_refnum))
+	unsigned int max_pdes = be16_to_cpu(ddf->phys->max_pdes);
+
+	if (ddf->index && be32_to_cpu(phys_refnum) != 0xffffffff) {
+		unsigned int mask = ddf->index->pd_size - 1;
+		unsigned int h = refnum_hash(phys_refnum) & mask;
+
+		for (; ddf->index->pd[h]; h = (h + 1) & mask) {
+			i = ddf->index->pd[h] - 1;
+			if (i < max_pdes &&
+			    be32_eq(ddf->phys->entries[i].refnum, phys_refnum))
+				return i;
+		}
+	}
+	for (i = 0; i < max_pdes; i++)
+		if (be32_eq(ddf->phys->entries[i].refnum, phys_refnum)) {
+			if (be32_to_cpu(phys_refnum) != 0xffffffff)
+				ddf_build_index(ddf);
 			return i;
+		}
 	return -1;
 }
 
@@ -2279,11 +2620,28 @@ static unsigned int find_vde_by_guid(const struct ddf_super *ddf,
 				     const char *guid)
 {
 	unsigned int i;
+	unsigned int max_vdes;
+
 	if (guid == NULL || all_ff(guid))
 		return DDF_NOTFOUND;
-	for (i = 0; i < be16_to_cpu(ddf->virt->max_vdes); i++)
-		if (!memcmp(ddf->virt->entries[i].guid, guid, DDF_GUID_LEN))
+	max_vdes = be16_to_cpu(ddf->virt->max_vdes);
+	if (ddf->index) {
+		unsigned int mask = ddf->index->vd_size - 1;
+		unsigned int h = guid_hash(guid) & mask;
+
+		for (; ddf->index->vd[h]; h = (h + 1) & mask) {
+			i = ddf->index->vd[h] - 1;
+			if (i < max_vdes &&
+			    !memcmp(ddf->virt->entries[i].guid, guid,
+				    DDF_GUID_LEN))
+				return i;
+		}
+	}
+	for (i = 0; i < max_vdes; i++)
+		if (!memcmp(ddf->virt->entries[i].guid, guid, DDF_GUID_LEN)) {
+			ddf_build_index(ddf);
 			return i;
+		}
 	return DDF_NOTFOUND;
 }
 #endif
@@ -2895,6 +3253,7 @@ static int add_to_super_ddf(struct supertype *st,
 	dd->devname = devname;
 	dd->fd = fd;
 	dd->spare = NULL;
+	ddf_alloc_written(ddf, dd);
 
 	dd->disk.magic = DDF_PHYS_DATA_MAGIC;
 	now = time(0);
@@ -3023,13 +3382,42 @@ static int remove_from_super_ddf(struct supertype *st, mdu_disk_info_t *dk)
  * container.
  */
 
+/* Write 'len' bytes at 'sector'.  If 'old' holds what is already
+ * there, only the runs of sectors which differ are written.
+ */
+static int ddf_write_changed(int fd, unsigned long long sector,
+			     void *buf, unsigned int len, const char *old)
+{
+	unsigned int s, e, n = len >> 9;
+
+	if (!old) {
+		if (lseek64(fd, sector<<9, 0) < 0)
+			return 0;
+		return write(fd, buf, len) == (ssize_t)len;
+	}
+	for (s = 0; s < n; s = e) {
+		if (memcmp(buf + (s<<9), old + (s<<9), 512) == 0) {
+			e = s + 1;
+			continue;
+		}
+		for (e = s + 1; e < n; e++)
+			if (memcmp(buf + (e<<9), old + (e<<9), 512) == 0)
+				break;
+		if (lseek64(fd, (sector + s)<<9, 0) < 0 ||
+		    write(fd, buf + (s<<9), (e - s)<<9) != (e - s)<<9)
+			return 0;
+	}
+	return 1;
+}
+
 static int __write_ddf_structure(struct dl *d, struct ddf_super *ddf, __u8 type)
 {
-	unsigned long long sector;
+	unsigned long long sector, pos;
 	struct ddf_header *header;
 	int fd, i, n_config, conf_size, buf_size;
 	int ret = 0;
 	char *conf;
+	char *old = NULL;
 
 	fd = d->fd;
 
@@ -3056,22 +3444,36 @@ static int __write_ddf_structure(struct dl *d, struct ddf_super *ddf, __u8 type)
 	if (write(fd, header, 512) < 0)
 		goto out;
 
+	/* Only sectors which changed since the last write need to go
+	 * out, as long as the layout has not changed.
+	 */
+	n_config = ddf->max_part;
+	conf_size = ddf->conf_rec_len * 512;
+	buf_size = conf_size * (n_config + 1);
+	if (d->written_len && d->written_len == ddf_written_size(ddf))
+		old = d->written;
+
+	pos = sector + 1;
 	ddf->controller.crc = calc_crc(&ddf->controller, 512);
-	if (write(fd, &ddf->controller, 512) < 0)
+	if (!ddf_write_changed(fd, pos, &ddf->controller, 512, old))
 		goto out;
+	pos += 1;
+	old = old ? old + 512 : NULL;
 
 	ddf->phys->crc = calc_crc(ddf->phys, ddf->pdsize);
-	if (write(fd, ddf->phys, ddf->pdsize) < 0)
+	if (!ddf_write_changed(fd, pos, ddf->phys, ddf->pdsize, old))
 		goto out;
+	pos += ddf->pdsize / 512;
+	old = old ? old + ddf->pdsize : NULL;
+
 	ddf->virt->crc = calc_crc(ddf->virt, ddf->vdsize);
-	if (write(fd, ddf->virt, ddf->vdsize) < 0)
+	if (!ddf_write_changed(fd, pos, ddf->virt, ddf->vdsize, old))
 		goto out;
+	pos += ddf->vdsize / 512;
+	old = old ? old + ddf->vdsize : NULL;
 
 	/* Now write lots of config records. */
-	n_config = ddf->max_part;
-	conf_size = ddf->conf_rec_len * 512;
 	conf = ddf->conf;
-	buf_size = conf_size * (n_config + 1);
 	if (!conf) {
 		if (posix_memalign((void**)&conf, 512, buf_size) != 0)
 			goto out;
@@ -3104,11 +3506,13 @@ static int __write_ddf_structure(struct dl *d, struct ddf_super *ddf, __u8 type)
 		} else
 			memset(conf + i*conf_size, 0xff, conf_size);
 	}
-	if (write(fd, conf, buf_size) != buf_size)
+	if (!ddf_write_changed(fd, pos, conf, buf_size, old))
 		goto out;
+	pos += buf_size / 512;
+	old = old ? old + buf_size : NULL;
 
 	d->disk.crc = calc_crc(&d->disk, 512);
-	if (write(fd, &d->disk, 512) < 0)
+	if (!ddf_write_changed(fd, pos, &d->disk, 512, old))
 		goto out;
 
 	ret = 1;
@@ -3123,6 +3527,32 @@ out:
 	return ret;
 }
 
+/* Remember the sections just written to both headers of 'd', so
+ * that next time only what changed need be written.  The config
+ * records were left in ddf->conf by __write_ddf_structure().
+ */
+static void ddf_note_written(struct ddf_super *ddf, struct dl *d)
+{
+	unsigned int buf_size = ddf->conf_rec_len * 512 * (ddf->max_part + 1);
+	unsigned int len = ddf_written_size(ddf);
+	char *p;
+
+	d->written_len = 0;
+	if (!ddf->conf || !d->written || d->written_size < len)
+		return;
+	d->written_len = len;
+	p = d->written;
+	memcpy(p, &ddf->controller, 512);
+	p += 512;
+	memcpy(p, ddf->phys, ddf->pdsize);
+	p += ddf->pdsize;
+	memcpy(p, ddf->virt, ddf->vdsize);
+	p += ddf->vdsize;
+	memcpy(p, ddf->conf, buf_size);
+	p += buf_size;
+	memcpy(p, &d->disk, 512);
+}
+
 static int _write_super_to_disk(struct ddf_super *ddf, struct dl *d)
 {
 	unsigned long long size;
@@ -3162,11 +3592,13 @@ static int _write_super_to_disk(struct ddf_super *ddf, struct dl *d)
 	ddf->anchor.seq = cpu_to_be32(0xFFFFFFFF); /* no sequencing in anchor */
 	ddf->anchor.crc = calc_crc(&ddf->anchor, 512);
 
-	if (!__write_ddf_structure(d, ddf, DDF_HEADER_PRIMARY))
-		return 0;
-
-	if (!__write_ddf_structure(d, ddf, DDF_HEADER_SECONDARY))
+	if (!__write_ddf_structure(d, ddf, DDF_HEADER_PRIMARY) ||
+	    !__write_ddf_structure(d, ddf, DDF_HEADER_SECONDARY)) {
+		/* we no longer know what is on the device */
+		d->written_len = 0;
 		return 0;
+	}
+	ddf_note_written(ddf, d);
 
 	lseek64(fd, (size-1)*512, SEEK_SET);
 	if (write(fd, &ddf->anchor, 512) < 0)
@@ -3185,6 +3617,7 @@ static int __write_init_super_ddf(struct supertype *st)
 
 	pr_state(ddf, __func__);
 
+	tracepoint(super_store_start, "ddf", -1, be32_to_cpu(ddf->primary.seq));
 	/* try to write updated metadata,
 	 * if we catch a failure move on to the next disk
 	 */
@@ -3192,6 +3625,7 @@ static int __write_init_super_ddf(struct supertype *st)
 		attempts++;
 		successes += _write_super_to_disk(ddf, d);
 	}
+	tracepoint(super_store_done, "ddf", -1, successes);
 
 	return attempts != successes;
 }
@@ -3574,11 +4008,14 @@ static int load_super_ddf_all(struct supertype *st, int fd,
 {
 	struct mdinfo *sra;
 	struct ddf_super *super;
-	struct mdinfo *sd, *best = NULL;
+	struct mdinfo *sd;
+	struct ddf_area *areas;
+	int best = -1;
 	int bestseq = 0;
 	int seq;
 	char nm[20];
-	int dfd;
+	int cnt, i;
+	int rv = 0;
 
 	sra = sysfs_read(fd, 0, GET_LEVEL|GET_VERSION|GET_DEVS|GET_STATE);
 	if (!sra)
@@ -3591,50 +4028,72 @@ static int load_super_ddf_all(struct supertype *st, int fd,
 	if (posix_memalign((void**)&super, 512, sizeof(*super)) != 0)
 		return 1;
 	memset(super, 0, sizeof(*super));
+	tracepoint(container_load_start, "ddf", fd);
+
+	/* Open every member and read all of their metadata together,
+	 * then work from memory.  The descriptors are kept by
+	 * load_ddf_local() so are opened read-write here.
+	 */
+	for (cnt = 0, sd = sra->devs ; sd ; sd = sd->next)
+		cnt++;
+	areas = xcalloc(cnt ? cnt : 1, sizeof(*areas));
+	for (i = 0, sd = sra->devs ; sd ; sd = sd->next, i++) {
+		int dfd;
 
-	/* first, try each device, and choose the best ddf */
-	for (sd = sra->devs ; sd ; sd = sd->next) {
-		int rv;
 		sprintf(nm, "%d:%d", sd->disk.major, sd->disk.minor);
-		dfd = dev_open(nm, O_RDONLY);
-		if (dfd < 0)
-			return 2;
-		rv = load_ddf_headers(dfd, super, NULL);
-		close(dfd);
-		if (rv == 0) {
+		dfd = dev_open(nm, O_RDWR);
+		if (dfd < 0) {
+			rv = 2;
+			cnt = i;
+			goto out;
+		}
+		ddf_area_init(&areas[i], dfd);
+	}
+	ddf_area_read(areas, cnt);
+
+	/* first, try each device, and choose the best ddf */
+	for (i = 0; i < cnt; i++) {
+		if (load_ddf_headers(&areas[i], super, NULL) == 0) {
 			seq = be32_to_cpu(super->active->seq);
 			if (super->active->openflag)
 				seq--;
-			if (!best || seq > bestseq) {
+			if (best < 0 || seq > bestseq) {
 				bestseq = seq;
-				best = sd;
+				best = i;
 			}
 		}
 	}
-	if (!best)
-		return 1;
+	if (best < 0) {
+		rv = 1;
+		goto out;
+	}
 	/* OK, load this ddf */
-	sprintf(nm, "%d:%d", best->disk.major, best->disk.minor);
-	dfd = dev_open(nm, O_RDONLY);
-	if (dfd < 0)
-		return 1;
-	load_ddf_headers(dfd, super, NULL);
-	load_ddf_global(dfd, super, NULL);
-	close(dfd);
+	load_ddf_headers(&areas[best], super, NULL);
+	load_ddf_global(&areas[best], super, NULL);
 	/* Now we need the device-local bits */
-	for (sd = sra->devs ; sd ; sd = sd->next) {
-		int rv;
-
-		sprintf(nm, "%d:%d", sd->disk.major, sd->disk.minor);
-		dfd = dev_open(nm, O_RDWR);
-		if (dfd < 0)
-			return 2;
-		rv = load_ddf_headers(dfd, super, NULL);
-		if (rv == 0)
-			rv = load_ddf_local(dfd, super, NULL, 1);
-		if (rv)
-			return 1;
+	for (i = 0; i < cnt; i++) {
+		rv = load_ddf_headers(&areas[i], super, NULL);
+		if (rv == 0) {
+			rv = load_ddf_local(&areas[i], super, NULL, 1);
+			/* the descriptor now belongs to super */
+			areas[i].fd = -1;
+		}
+		if (rv) {
+			rv = 1;
+			goto out;
+		}
 	}
+out:
+	for (i = 0; i < cnt; i++) {
+		if (areas[i].fd >= 0)
+			close(areas[i].fd);
+		ddf_area_free(&areas[i]);
+	}
+	free(areas);
+	tracepoint(container_load_done, "ddf", fd, rv);
+	if (rv)
+		return rv;
+	ddf_alloc_index(super);
 
 	*sbp = super;
 	if (st->ss == NULL) {
@@ -3922,6 +4381,8 @@ static int store_super_ddf(struct supertype *st, int fd)
 		}
 		ofd = dl->fd;
 		dl->fd = fd;
+		/* no assumptions about what 'fd' holds */
+		dl->written_len = 0;
 		ret = (_write_super_to_disk(ddf, dl) != 1);
 		dl->fd = ofd;
 		return ret;
@@ -4038,6 +4499,7 @@ static int compare_super_ddf(struct supertype *st, struct supertype *tst)
 		}
 		memcpy(dl1, dl2, sizeof(*dl1));
 		dl1->mdupdate = NULL;
+		ddf_alloc_written(first, dl1);
 		dl1->next = first->dlist;
 		dl1->fd = -1;
 		for (pd = 0; pd < max_pds; pd++)
@@ -4468,6 +4930,10 @@ static int _kill_subarray_ddf(struct ddf_super *ddf, const char *guid)
 				    DDF_GUID_LEN))
 				dl->vlist[i] = NULL;
 	memset(ddf->virt->entries[vdnum].guid, 0xff, DDF_GUID_LEN);
+	/* The manager may be using the index, so refill it rather than
+	 * free it; like the vcl, it must outlive this update.
+	 */
+	ddf_build_index(ddf);
 	dprintf("deleted %s\n", guid_str(guid));
 	return 0;
 }
@@ -4562,6 +5028,11 @@ static void ddf_process_phys_update(struct supertype *st,
 				dl->fd = -1;
 				*dlp = dl->next;
 				update->space = dl->devname;
+				if (dl->written) {
+					*(void**)dl->written =
+						update->space_list;
+					update->space_list = dl->written;
+				}
 				*(void**)dl = update->space_list;
 				update->space_list = (void**)dl;
 				break;
@@ -26,6 +26,8 @@
 #include <scsi/sg.h>
 #include <ctype.h>
 #include <dirent.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 /* MPB == Metadata Parameter Block */
 #define MPB_SIGNATURE "Intel Raid ISM Cfg Sig. "
@@ -345,6 +347,37 @@ enum action {
 	DISK_REMOVE = 1,
 	DISK_ADD
 };
+
+/* While a general migration is driven by imsm_manage_reshape() the copy
+ * area targets and the two devices carrying the migration record are
+ * opened once, rather than for every migration unit.
+ */
+struct imsm_reshape_io {
+	int *targets;	/* by raid_disk, -1 if missing */
+	int new_disks;
+	int rec_cnt;
+	int rec_fd[2];
+	unsigned long long rec_offset[2]; /* [bytes] */
+};
+/* Scratch space for write_mpb_batch(), enough for an mpb of up to
+ * 'len' bytes on every possible member.  mdmon's monitor thread writes
+ * the metadata and must not allocate, so this is set up along with
+ * the mpb buffer, see imsm_alloc_write_space().
+ */
+struct imsm_write_space {
+	size_t len;
+	struct md_io *io;	/* 1 + len/512 per disk */
+	struct dl **dls;
+	unsigned long long *dsize;
+	int *failed;		/* errno, or 0 */
+	int *ios;		/* extended mpb requests */
+	/* the mpb as last written and the member disks known to hold
+	 * it, see intel_super->written_len and ->written_cnt
+	 */
+	void *written_mpb;	/* len bytes */
+	struct dl **written;
+};
+
 /* internal representation of IMSM metadata */
 struct intel_super {
 	union {
@@ -358,9 +391,12 @@ struct intel_super {
 	int clean_migration_record_by_mdmon; /* when reshape is switched to next
 		array, it indicates that mdmon is allowed to clean migration
 		record */
+	struct imsm_reshape_io *reshape_io; /* devices held open while
+					     * imsm_manage_reshape() runs */
 	size_t len; /* size of the 'buf' allocation */
 	void *next_buf; /* for realloc'ing buf from the manager */
 	size_t next_len;
+	struct imsm_write_space *ws, *next_ws; /* likewise */
 	int updates_pending; /* count of pending updates for mdmon */
 	int current_vol; /* index of raid device undergoing creation */
 	unsigned long long create_offset; /* common start for 'current_vol' */
@@ -379,6 +415,14 @@ struct intel_super {
 		int raiddisk; /* slot to fill in autolayout */
 		enum action action;
 	} *disks, *current_disk;
+	/* lookup indexes into 'disks', see get_imsm_dl_disk() */
+	struct dl **disk_tbl; /* by disk index */
+	struct dl **serial_tbl; /* hash of serial numbers */
+	/* how much of ws->written_mpb and ws->written is valid, see
+	 * write_mpb_batch()
+	 */
+	size_t written_len;
+	int written_cnt;
 	struct dl *disk_mgmt_list; /* list of disks to add/remove while mdmon
 				      active */
 	struct dl *missing; /* disks removed while we weren't looking */
@@ -578,30 +622,214 @@ static int attach_hba_to_super(struct intel_super *super, struct sys_dev *device
 	return 1;
 }
 
+extern int scsi_get_serial(int fd, void *buf, size_t buf_len);
+
+/* Loading a container looks up the serial number (a SCSI inquiry,
+ * which can be slow) and controller path of every member, some of them
+ * more than once.  Remember the answers by device number, but only for
+ * the length of one container load (see disk_cache_get()): a long
+ * lived mdmon could otherwise give a newly added disk the serial of
+ * one just removed from the same device number.
+ */
+#define IMSM_SCSI_SERIAL_LEN 255
+struct imsm_disk_cache {
+	dev_t devid;
+	int valid;
+	int serial_rv;
+	unsigned char scsi_serial[IMSM_SCSI_SERIAL_LEN];
+	char *devpath;	/* NULL if not a whole disk */
+	struct imsm_disk_cache *next;
+};
+static struct imsm_disk_cache *imsm_disk_cache;
+static int imsm_disk_cache_users; /* container loads in progress */
+
+/* Loads nest, as a devlist may include a container; the cache is
+ * emptied when the outermost one finishes.
+ */
+static void disk_cache_get(void)
+{
+	imsm_disk_cache_users++;
+}
+
+static void disk_cache_put(void)
+{
+	struct imsm_disk_cache *c;
+
+	if (--imsm_disk_cache_users > 0)
+		return;
+	while ((c = imsm_disk_cache) != NULL) {
+		imsm_disk_cache = c->next;
+		free(c->devpath);
+		free(c);
+	}
+}
+
+static struct imsm_disk_cache *disk_cache_find(dev_t devid, int create)
+{
+	struct imsm_disk_cache *c;
+
+	if (!imsm_disk_cache_users)
+		return NULL;
+	for (c = imsm_disk_cache; c; c = c->next)
+		if (c->devid == devid)
+			break;
+	if (c && c->valid)
+		return c;
+	if (!create)
+		return NULL;
+	if (!c) {
+		c = xcalloc(1, sizeof(*c));
+		c->devid = devid;
+		c->next = imsm_disk_cache;
+		imsm_disk_cache = c;
+	}
+	free(c->devpath);
+	c->devpath = NULL;
+	c->valid = 0;
+	return c;
+}
+
+static void disk_cache_fill(struct imsm_disk_cache *c, int fd)
+{
+	memset(c->scsi_serial, 0, sizeof(c->scsi_serial));
+	c->serial_rv = scsi_get_serial(fd, c->scsi_serial,
+				       sizeof(c->scsi_serial));
+	c->devpath = devt_to_devpath(c->devid);
+	c->valid = 1;
+}
+
+static struct imsm_disk_cache *disk_cache_fd(int fd)
+{
+	struct imsm_disk_cache *c;
+	struct stat st;
+
+	if (fstat(fd, &st) != 0 || !S_ISBLK(st.st_mode))
+		return NULL;
+	c = disk_cache_find(st.st_rdev, 1);
+	if (c && !c->valid)
+		disk_cache_fill(c, fd);
+	return c;
+}
+
+static int imsm_get_scsi_serial(int fd, unsigned char *buf, size_t len)
+{
+	struct imsm_disk_cache *c = disk_cache_fd(fd);
+
+	if (!c)
+		return scsi_get_serial(fd, buf, len);
+	if (len > sizeof(c->scsi_serial))
+		len = sizeof(c->scsi_serial);
+	memcpy(buf, c->scsi_serial, len);
+	return c->serial_rv;
+}
+
+/* Fill the cache for all members of a container at once, with a child
+ * process per disk so that the inquiries run in parallel.  Results are
+ * passed back in a shared mapping.  Anything that goes wrong here just
+ * leaves the lookup to be done later, one disk at a time.
+ */
+#define IMSM_PROBE_JOBS 32
+struct imsm_probe {
+	dev_t devid;
+	pid_t pid;
+	int done;
+	int serial_rv;
+	unsigned char scsi_serial[IMSM_SCSI_SERIAL_LEN];
+	char devpath[PATH_MAX];
+};
+
+static void imsm_probe_disks(dev_t *devids, int cnt)
+{
+	struct imsm_probe *p;
+	int i, n = 0, reaped = 0;
+
+	if (cnt < 2 || !imsm_disk_cache_users)
+		return;
+	p = mmap(NULL, cnt * sizeof(*p), PROT_READ|PROT_WRITE,
+		 MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return;
+	for (i = 0; i < cnt; i++)
+		if (!disk_cache_find(devids[i], 0))
+			p[n++].devid = devids[i];
+
+	fflush(stdout);
+	for (i = 0; i < n; i++) {
+		pid_t pid;
+
+		if (i - reaped >= IMSM_PROBE_JOBS)
+			waitpid(p[reaped++].pid, NULL, 0);
+		pid = fork();
+		if (pid == 0) {
+			char nm[32];
+			char *path;
+			int fd;
+
+			sprintf(nm, "%d:%d", major(p[i].devid),
+				minor(p[i].devid));
+			fd = dev_open(nm, O_RDONLY);
+			if (fd < 0)
+				_exit(1);
+			p[i].serial_rv = scsi_get_serial(fd, p[i].scsi_serial,
+							 sizeof(p[i].scsi_serial));
+			path = devt_to_devpath(p[i].devid);
+			if (path && strlen(path) < sizeof(p[i].devpath))
+				strcpy(p[i].devpath, path);
+			p[i].done = path ? 1 : 2;
+			_exit(0);
+		}
+		if (pid < 0)
+			break;
+		p[i].pid = pid;
+	}
+	for (; reaped < i; reaped++)
+		waitpid(p[reaped].pid, NULL, 0);
+
+	for (i = 0; i < n; i++) {
+		struct imsm_disk_cache *c;
+
+		if (!p[i].done)
+			continue;
+		c = disk_cache_find(p[i].devid, 1);
+		memcpy(c->scsi_serial, p[i].scsi_serial,
+		       sizeof(c->scsi_serial));
+		c->serial_rv = p[i].serial_rv;
+		if (p[i].done == 1)
+			c->devpath = xstrdup(p[i].devpath);
+		c->valid = 1;
+	}
+	munmap(p, cnt * sizeof(*p));
+}
+
 static struct sys_dev* find_disk_attached_hba(int fd, const char *devname)
 {
 	struct sys_dev *list, *elem;
-	char *disk_path;
+	const char *disk_path;
+	char *path = NULL;
 
 	if ((list = find_intel_devices()) == NULL)
 		return 0;
 
 	if (fd < 0)
-		disk_path  = (char *) devname;
-	else
-		disk_path = diskfd_to_devpath(fd);
+		disk_path = devname;
+	else {
+		struct imsm_disk_cache *c = disk_cache_fd(fd);
+
+		if (c)
+			disk_path = c->devpath;
+		else
+			disk_path = path = diskfd_to_devpath(fd);
+	}
 
 	if (!disk_path)
 		return 0;
 
 	for (elem = list; elem; elem = elem->next)
 		if (path_attached_to_hba(disk_path, elem->path))
-			return elem;
-
-	if (disk_path != devname)
-		free(disk_path);
+			break;
 
-	return NULL;
+	free(path);
+	return elem;
 }
 
 static int find_intel_hba_capability(int fd, struct intel_super *super,
@@ -641,6 +869,82 @@ static struct imsm_disk *__get_imsm_disk(struct imsm_super *mpb, __u8 index)
 	return &mpb->disk[index];
 }
 
+static int serialcmp(__u8 *s1, __u8 *s2);
+
+static unsigned int serial_hash(__u8 *serial)
+{
+	unsigned int h = 2166136261U;
+	int i;
+
+	for (i = 0; i < MAX_RAID_SERIAL_LEN && serial[i]; i++)
+		h = (h ^ serial[i]) * 16777619U;
+	return h;
+}
+
+/* 'disks' is indexed by disk index and by serial number.  Disks are
+ * added, removed and renumbered in many places, so rather than keep the
+ * indexes up to date everywhere, every hit is checked against the disk
+ * itself, and when a lookup has to fall back to walking the list and
+ * finds the disk there the indexes are rebuilt.  They must also be
+ * rebuilt as soon as a disk is unlinked, before it is freed.
+ *
+ * Both mdmon threads look disks up and the monitor thread deletes them,
+ * so the tables are allocated once when the metadata is loaded or
+ * created, only ever refilled in place, and freed by __free_imsm().
+ * Without them lookups just walk the list.
+ */
+#define IMSM_SERIAL_TBL_SIZE 1024 /* power of 2, > 2 * possible disks */
+
+static void imsm_alloc_disk_index(struct intel_super *super)
+{
+	if (super->disk_tbl && super->serial_tbl)
+		return;
+	free(super->disk_tbl);
+	free(super->serial_tbl);
+	super->disk_tbl = calloc(256, sizeof(struct dl *));
+	super->serial_tbl = calloc(IMSM_SERIAL_TBL_SIZE, sizeof(struct dl *));
+	if (!super->disk_tbl || !super->serial_tbl) {
+		free(super->disk_tbl);
+		super->disk_tbl = NULL;
+		free(super->serial_tbl);
+		super->serial_tbl = NULL;
+	}
+}
+
+static void imsm_build_disk_index(struct intel_super *super)
+{
+	struct dl *d;
+	int size = IMSM_SERIAL_TBL_SIZE;
+	int n = 0;
+
+	if (!super->disk_tbl || !super->serial_tbl)
+		return;
+	memset(super->serial_tbl, 0, size * sizeof(struct dl *));
+	memset(super->disk_tbl, 0, 256 * sizeof(struct dl *));
+
+	/* the first of any duplicates wins, as in a list walk */
+	for (d = super->disks; d && n < size / 2; d = d->next, n++) {
+		unsigned int h = serial_hash(d->serial) & (size - 1);
+
+		if (d->index >= 0 && d->index < 256 && !super->disk_tbl[d->index])
+			super->disk_tbl[d->index] = d;
+		while (super->serial_tbl[h] &&
+		       serialcmp(super->serial_tbl[h]->serial, d->serial) != 0)
+			h = (h + 1) & (size - 1);
+		if (!super->serial_tbl[h])
+			super->serial_tbl[h] = d;
+	}
+}
+
+/* A disk has just been unlinked from 'disks' and is about to be freed,
+ * and its 'struct dl' may then be reused.
+ */
+static void imsm_drop_disk_index(struct intel_super *super)
+{
+	super->written_cnt = 0;
+	imsm_build_disk_index(super);
+}
+
 /* retrieve the disk description based on a index of the disk
  * in the sub-array
  */
@@ -648,9 +952,17 @@ static struct dl *get_imsm_dl_disk(struct intel_super *super, __u8 index)
 {
 	struct dl *d;
 
+	if (super->disk_tbl) {
+		d = super->disk_tbl[index];
+		if (d && d->index == index)
+			return d;
+	}
+
 	for (d = super->disks; d; d = d->next)
-		if (d->index == index)
+		if (d->index == index) {
+			imsm_build_disk_index(super);
 			return d;
+		}
 
 	return NULL;
 }
@@ -671,14 +983,7 @@ static struct imsm_disk *get_imsm_disk(struct intel_super *super, __u8 index)
  */
 static __u32 __gen_imsm_checksum(struct imsm_super *mpb)
 {
-	__u32 end = mpb->mpb_size / sizeof(end);
-	__u32 *p = (__u32 *) mpb;
-	__u32 sum = 0;
-
-	while (end--) {
-		sum += __le32_to_cpu(*p);
-		p++;
-	}
+	__u32 sum = sum_le32(mpb, mpb->mpb_size & ~3);
 
 	return sum - __le32_to_cpu(mpb->check_sum);
 }
@@ -816,16 +1121,44 @@ static void set_imsm_ord_tbl_ent(struct imsm_map *map, int slot, __u32 ord)
 
 static int get_imsm_disk_slot(struct imsm_map *map, unsigned idx)
 {
+	/* slot + 1 for each disk index in the map last looked at.  An
+	 * entry is checked against the ord table before it is used, so
+	 * this never goes stale, and it is per thread for mdmon.
+	 */
+	static __thread struct imsm_map *cached_map;
+	static __thread __u16 cached_slot[256];
 	int slot;
 	__u32 ord;
 
+	if (map == cached_map && idx < 256 && cached_slot[idx]) {
+		slot = cached_slot[idx] - 1;
+		if (slot < map->num_members &&
+		    ord_to_idx(__le32_to_cpu(map->disk_ord_tbl[slot])) == idx)
+			return slot;
+	}
+
 	for (slot = 0; slot < map->num_members; slot++) {
 		ord = __le32_to_cpu(map->disk_ord_tbl[slot]);
 		if (ord_to_idx(ord) == idx)
-			return slot;
+			break;
 	}
+	if (slot == map->num_members)
+		return -1;
 
-	return -1;
+	if (map != cached_map) {
+		int i;
+
+		cached_map = map;
+		memset(cached_slot, 0, sizeof(cached_slot));
+		for (i = map->num_members - 1; i >= 0; i--) {
+			unsigned int x = ord_to_idx(__le32_to_cpu(map->disk_ord_tbl[i]));
+
+			if (x < 256)
+				cached_slot[x] = i + 1;
+		}
+	} else if (idx < 256)
+		cached_slot[idx] = slot + 1;
+	return slot;
 }
 
 static int get_imsm_raid_level(struct imsm_map *map)
@@ -2504,7 +2837,26 @@ static int write_imsm_migr_rec(struct supertype *st)
 
 	map = get_imsm_map(dev, MAP_0);
 
-	for (sd = super->disks ; sd ; sd = sd->next) {
+	if (super->reshape_io) {
+		struct imsm_reshape_io *rio = super->reshape_io;
+		struct md_io io[2];
+		int i;
+
+		for (i = 0; i < rio->rec_cnt; i++) {
+			io[i].fd = rio->rec_fd[i];
+			io[i].write = 1;
+			io[i].buf = super->migr_rec_buf;
+			io[i].len = MIGR_REC_BUF_SIZE;
+			io[i].offset = rio->rec_offset[i];
+		}
+		if (md_io_batch(io, rio->rec_cnt)) {
+			pr_err("Cannot write migr record block\n");
+			goto out;
+		}
+	}
+
+	/* otherwise open each device in turn */
+	for (sd = super->reshape_io ? NULL : super->disks ; sd ; sd = sd->next) {
 		int slot = -1;
 
 		/* skip failed and spare devices */
@@ -3233,8 +3585,6 @@ static void fd2devname(int fd, char *name)
 	}
 }
 
-extern int scsi_get_serial(int fd, void *buf, size_t buf_len);
-
 static int imsm_read_serial(int fd, char *devname,
 			    __u8 serial[MAX_RAID_SERIAL_LEN])
 {
@@ -3249,7 +3599,7 @@ static int imsm_read_serial(int fd, char *devname,
 
 	memset(scsi_serial, 0, sizeof(scsi_serial));
 
-	rv = scsi_get_serial(fd, scsi_serial, sizeof(scsi_serial));
+	rv = imsm_get_scsi_serial(fd, scsi_serial, sizeof(scsi_serial));
 
 	if (rv && check_env("IMSM_DEVNAME_AS_SERIAL")) {
 		memset(serial, 0, MAX_RAID_SERIAL_LEN);
@@ -3317,9 +3667,20 @@ static struct dl *serial_to_dl(__u8 *serial, struct intel_super *super)
 {
 	struct dl *dl;
 
+	if (super->serial_tbl) {
+		int mask = IMSM_SERIAL_TBL_SIZE - 1;
+		unsigned int h = serial_hash(serial) & mask;
+
+		for (; (dl = super->serial_tbl[h]) != NULL; h = (h + 1) & mask)
+			if (serialcmp(dl->serial, serial) == 0)
+				return dl;
+	}
+
 	for (dl = super->disks; dl; dl = dl->next)
-		if (serialcmp(dl->serial, serial) == 0)
+		if (serialcmp(dl->serial, serial) == 0) {
+			imsm_build_disk_index(super);
 			break;
+		}
 
 	return dl;
 }
@@ -3586,6 +3947,90 @@ int check_mpb_migr_compatibility(struct intel_super *super)
 
 static void __free_imsm(struct intel_super *super, int free_disks);
 
+/* Allocate write space for an mpb of up to 'len' bytes in one piece.
+ * Returns NULL if there is no memory, without exiting, as the manager
+ * copes with that.
+ */
+static struct imsm_write_space *imsm_alloc_write_space(size_t len)
+{
+	int disks = IMSM_MAX_DEVICES;
+	size_t per_disk = 1 + len / 512;
+	struct imsm_write_space *ws;
+	char *p;
+
+	ws = calloc(1, sizeof(*ws) +
+		    disks * (per_disk * sizeof(struct md_io) +
+			     sizeof(unsigned long long) +
+			     2 * sizeof(struct dl *) + 2 * sizeof(int)) +
+		    len);
+	if (!ws)
+		return NULL;
+	ws->len = len;
+	p = (char *)(ws + 1);
+	ws->io = (struct md_io *)p;
+	p += disks * per_disk * sizeof(struct md_io);
+	ws->dsize = (unsigned long long *)p;
+	p += disks * sizeof(unsigned long long);
+	ws->dls = (struct dl **)p;
+	p += disks * sizeof(struct dl *);
+	ws->written = (struct dl **)p;
+	p += disks * sizeof(struct dl *);
+	ws->failed = (int *)p;
+	p += disks * sizeof(int);
+	ws->ios = (int *)p;
+	p += disks * sizeof(int);
+	ws->written_mpb = p;
+	return ws;
+}
+
+/* monitor side: nothing is allocated here, what the disks hold is
+ * just carried over
+ */
+static void imsm_use_next_write_space(struct intel_super *super)
+{
+	struct imsm_write_space *ws = super->ws;
+
+	if (!super->next_ws)
+		return;
+	if (ws && super->written_len <= super->next_ws->len) {
+		memcpy(super->next_ws->written_mpb, ws->written_mpb,
+		       super->written_len);
+		memcpy(super->next_ws->written, ws->written,
+		       super->written_cnt * sizeof(*ws->written));
+	} else
+		super->written_cnt = 0;
+	free(super->ws);
+	super->ws = super->next_ws;
+	super->next_ws = NULL;
+}
+
+/* Make sure the write space will fit a 'len' byte mpb, allocating a
+ * new one if not.  With 'next', mdmon's manager is preparing for
+ * process_update() to switch to a larger buffer, so the new space is
+ * left in ->next_ws for imsm_use_next_write_space().
+ */
+static int imsm_prepare_write_space(struct intel_super *super, size_t len,
+				    int next)
+{
+	struct imsm_write_space *ws = super->ws;
+
+	if (next && super->next_ws)
+		ws = super->next_ws;
+	if (ws && ws->len >= len)
+		return 0;
+	ws = imsm_alloc_write_space(len);
+	if (!ws)
+		return 1;
+	free(super->next_ws);
+	super->next_ws = ws;
+	if (!next)
+		/* loading, or mdadm writing new metadata: no update
+		 * can be pending
+		 */
+		imsm_use_next_write_space(super);
+	return 0;
+}
+
 /* load_imsm_mpb - read matrix metadata
  * allocates super->mpb to be freed by free_imsm
  */
@@ -3737,14 +4182,23 @@ load_and_parse_mpb(int fd, struct intel_super *super, char *devname, int keep_fd
 {
 	int err;
 
+	tracepoint(super_load_start, "imsm", fd, 0);
 	err = load_imsm_mpb(fd, super, devname);
-	if (err)
-		return err;
-	err = load_imsm_disk(fd, super, devname, keep_fd);
-	if (err)
-		return err;
-	err = parse_raid_devices(super);
-	clear_hi(super);
+	if (!err)
+		err = load_imsm_disk(fd, super, devname, keep_fd);
+	if (!err) {
+		err = parse_raid_devices(super);
+		clear_hi(super);
+	}
+	if (!err)
+		imsm_alloc_disk_index(super);
+	if (!err && imsm_prepare_write_space(super, super->len, 0)) {
+		if (devname)
+			pr_err("unable to allocate write space for %s\n",
+			       devname);
+		err = 2;
+	}
+	tracepoint(super_load_done, "imsm", fd, err);
 	return err;
 }
 
@@ -3779,7 +4233,7 @@ static void free_imsm_disks(struct intel_super *super)
 		super->missing = d->next;
 		__free_imsm_disk(d);
 	}
-
+	imsm_drop_disk_index(super);
 }
 
 /* free all the pieces hanging off of a super pointer */
@@ -3799,6 +4253,15 @@ static void __free_imsm(struct intel_super *super, int free_disks)
 	}
 	if (free_disks)
 		free_imsm_disks(super);
+	free(super->disk_tbl);
+	super->disk_tbl = NULL;
+	free(super->serial_tbl);
+	super->serial_tbl = NULL;
+	super->written_cnt = 0;
+	free(super->ws);
+	super->ws = NULL;
+	free(super->next_ws);
+	super->next_ws = NULL;
 	free_devlist(super);
 	elem = super->hba;
 	while (elem) {
@@ -4253,6 +4716,7 @@ static int load_super_imsm_all(struct supertype *st, int fd, void **sbp,
 	int err = 0;
 	int i = 0;
 
+	tracepoint(container_load_start, "imsm", fd);
 	if (fd >= 0)
 		/* 'fd' is an opened container */
 		err = get_sra_super_block(fd, &super_list, devname, &i, keep_fd);
@@ -4306,6 +4770,7 @@ static int load_super_imsm_all(struct supertype *st, int fd, void **sbp,
 		free_imsm(s);
 	}
 
+	tracepoint(container_load_done, "imsm", fd, err);
 	if (err)
 		return err;
 
@@ -4327,9 +4792,20 @@ get_devlist_super_block(struct md_list *devlist, struct intel_super **super_list
 			int *max, int keep_fd)
 {
 	struct md_list *tmpdev;
+	dev_t *devids;
 	int err = 0;
 	int i = 0;
 
+	disk_cache_get();
+	for (tmpdev = devlist; tmpdev; tmpdev = tmpdev->next)
+		i++;
+	devids = xcalloc(i + 1, sizeof(*devids));
+	for (i = 0, tmpdev = devlist; tmpdev; tmpdev = tmpdev->next)
+		if (tmpdev->used == 1 && tmpdev->container != 1)
+			devids[i++] = tmpdev->st_rdev;
+	imsm_probe_disks(devids, i);
+	free(devids);
+
 	for (i = 0, tmpdev = devlist; tmpdev; tmpdev = tmpdev->next) {
 		if (tmpdev->used != 1)
 			continue;
@@ -4367,6 +4843,7 @@ get_devlist_super_block(struct md_list *devlist, struct intel_super **super_list
 		}
 	}
  error:
+	disk_cache_put();
 	*max = i;
 	return err;
 }
@@ -4426,6 +4903,7 @@ get_sra_super_block(int fd, struct intel_super **super_list, char *devname, int
 	struct mdinfo *sra;
 	char *devnm;
 	struct mdinfo *sd;
+	dev_t *devids;
 	int err = 0;
 	int i = 0;
 	sra = sysfs_read(fd, NULL, GET_LEVEL|GET_VERSION|GET_DEVS|GET_STATE);
@@ -4438,15 +4916,25 @@ get_sra_super_block(int fd, struct intel_super **super_list, char *devname, int
 		err = 1;
 		goto error;
 	}
-	/* load all mpbs */
+	/* probe all members together, then load all mpbs */
+	disk_cache_get();
+	for (sd = sra->devs; sd; sd = sd->next)
+		i++;
+	devids = xcalloc(i + 1, sizeof(*devids));
+	for (sd = sra->devs, i = 0; sd; sd = sd->next, i++)
+		devids[i] = makedev(sd->disk.major, sd->disk.minor);
+	imsm_probe_disks(devids, i);
+	free(devids);
+
 	devnm = fd2devnm(fd);
 	for (sd = sra->devs, i = 0; sd; sd = sd->next, i++) {
 		if (get_super_block(super_list, devnm, devname,
 				    sd->disk.major, sd->disk.minor, keep_fd) != 0) {
 			err = 7;
-			goto error;
+			break;
 		}
 	}
+	disk_cache_put();
  error:
 	sysfs_free(sra);
 	*max = i;
@@ -4824,6 +5312,7 @@ static int init_super_imsm(struct supertype *st, mdu_array_info_t *info,
 		return 0;
 	}
 	memset(super->buf, 0, mpb_size);
+	imsm_alloc_disk_index(super);
 	mpb = super->buf;
 	mpb->mpb_size = __cpu_to_le32(mpb_size);
 	st->sb = super;
@@ -5152,6 +5641,178 @@ static int write_super_imsm_spares(struct intel_super *super, int doclose)
 	return 0;
 }
 
+static int imsm_holds_written(struct intel_super *super, struct dl *d)
+{
+	int i;
+
+	for (i = 0; i < super->written_cnt; i++)
+		if (super->ws->written[i] == d)
+			return 1;
+	return 0;
+}
+
+/* Write the migration record (if it is being cleared) and the mpb to
+ * all member disks.  Rather than a seek and write at a time per disk,
+ * the I/O for all disks is submitted together so that they work in
+ * parallel.  The extended mpb sectors go first and the anchor is only
+ * written once they are safely down, so an interrupted update never
+ * leaves an anchor describing sectors that were not written.
+ *
+ * A copy of the mpb is kept along with the list of disks it reached.
+ * Those disks only get the extended sectors that have changed since;
+ * the anchor always changes as it carries the generation and checksum.
+ *
+ * All the scratch space comes from super->ws.  mdmon always has that
+ * ready (see load_and_parse_mpb() and imsm_prepare_update()); only
+ * mdadm writing metadata it has just created may need it allocated
+ * here.  Returns 1 if that fails.
+ */
+static int write_mpb_batch(struct intel_super *super, int cnt,
+			   int clear_migration_record)
+{
+	struct imsm_super *mpb = super->anchor;
+	__u32 mpb_size = __le32_to_cpu(mpb->mpb_size);
+	unsigned long long sectors = mpb_sectors(mpb) - 1;
+	size_t len = (sectors + 1) * 512;
+	struct md_io *io;
+	struct dl **dls;
+	unsigned long long *dsize;
+	int *failed;
+	int *ios;
+	char *written = NULL;
+	struct dl *d;
+	int i, n, j;
+
+	if (imsm_prepare_write_space(super, len, 0)) {
+		pr_err("could not allocate metadata write space\n");
+		return 1;
+	}
+	io = super->ws->io;
+	dls = super->ws->dls;
+	dsize = super->ws->dsize;
+	failed = super->ws->failed;
+	ios = super->ws->ios;
+	if (cnt > IMSM_MAX_DEVICES)
+		cnt = IMSM_MAX_DEVICES;
+
+	if (super->written_cnt && super->written_len == len)
+		written = super->ws->written_mpb;
+
+	for (d = super->disks, i = 0; d && i < cnt; d = d->next) {
+		if (d->index < 0 || is_failed(&d->disk))
+			continue;
+		dls[i] = d;
+		dsize[i] = 0;
+		failed[i] = 0;
+		ios[i] = 0;
+		if (!get_dev_size(d->fd, NULL, &dsize[i]))
+			failed[i] = errno ? errno : EIO;
+		i++;
+	}
+	cnt = i;
+
+	/* phase 1: migration record and extended mpb */
+	for (i = 0, n = 0; i < cnt; i++) {
+		if (failed[i])
+			continue;
+		if (clear_migration_record) {
+			io[n].fd = dls[i]->fd;
+			io[n].write = 1;
+			io[n].buf = super->migr_rec_buf;
+			io[n].len = MIGR_REC_BUF_SIZE;
+			io[n].offset = dsize[i] - 512;
+			n++;
+		}
+		if (mpb_size > 512 &&
+		    (!written || !imsm_holds_written(super, dls[i]))) {
+			io[n].fd = dls[i]->fd;
+			io[n].write = 1;
+			io[n].buf = (char *)mpb + 512;
+			io[n].len = 512 * sectors;
+			io[n].offset = dsize[i] - 512 * (2 + sectors);
+			n++;
+			ios[i] = 1;
+		} else if (mpb_size > 512) {
+			/* just the runs of sectors that differ */
+			unsigned long long s, e;
+
+			for (s = 1; s <= sectors; s = e) {
+				if (memcmp((char *)mpb + s * 512,
+					   written + s * 512, 512) == 0) {
+					e = s + 1;
+					continue;
+				}
+				for (e = s + 1; e <= sectors; e++)
+					if (memcmp((char *)mpb + e * 512,
+						   written + e * 512, 512) == 0)
+						break;
+				io[n].fd = dls[i]->fd;
+				io[n].write = 1;
+				io[n].buf = (char *)mpb + s * 512;
+				io[n].len = 512 * (e - s);
+				io[n].offset = dsize[i] - 512 * (2 + sectors)
+					+ 512 * (s - 1);
+				n++;
+				ios[i]++;
+			}
+		}
+	}
+	if (n && md_io_batch(io, n)) {
+		for (i = 0, n = 0; i < cnt; i++) {
+			if (failed[i])
+				continue;
+			if (clear_migration_record) {
+				if (io[n].rv != MIGR_REC_BUF_SIZE) {
+					errno = io[n].rv < 0 ? -io[n].rv : EIO;
+					perror("Write migr_rec failed");
+				}
+				n++;
+			}
+			for (j = 0; j < ios[i]; j++, n++)
+				if (io[n].rv != (long long)io[n].len)
+					failed[i] = io[n].rv < 0 ? -io[n].rv : EIO;
+		}
+	}
+
+	/* phase 2: the anchor, on the second to last sector */
+	for (i = 0, n = 0; i < cnt; i++) {
+		if (failed[i])
+			continue;
+		io[n].fd = dls[i]->fd;
+		io[n].write = 1;
+		io[n].buf = mpb;
+		io[n].len = 512;
+		io[n].offset = dsize[i] - 512 * 2;
+		io[n].rv = 0;
+		n++;
+	}
+	if (n && md_io_batch(io, n)) {
+		for (i = 0, n = 0; i < cnt; i++) {
+			if (failed[i])
+				continue;
+			if (io[n].rv != 512)
+				failed[i] = io[n].rv < 0 ? -io[n].rv : EIO;
+			n++;
+		}
+	}
+
+	for (i = 0; i < cnt; i++)
+		if (failed[i])
+			fprintf(stderr,
+				"failed for device %d:%d (fd: %d)%s\n",
+				dls[i]->major, dls[i]->minor,
+				dls[i]->fd, strerror(failed[i]));
+
+	/* remember what the disks now hold */
+	memcpy(super->ws->written_mpb, mpb, len);
+	super->written_len = len;
+	for (i = 0, n = 0; i < cnt; i++)
+		if (!failed[i])
+			super->ws->written[n++] = dls[i];
+	super->written_cnt = n;
+	return 0;
+}
+
 static int write_super_imsm(struct supertype *st, int doclose)
 {
 	struct intel_super *super = st->sb;
@@ -5163,12 +5824,14 @@ static int write_super_imsm(struct supertype *st, int doclose)
 	int i;
 	__u32 mpb_size = sizeof(struct imsm_super) - sizeof(struct imsm_disk);
 	int num_disks = 0;
+	int members = 0;
 	int clear_migration_record = 1;
 
 	/* 'generation' is incremented everytime the metadata is written */
 	generation = __le32_to_cpu(mpb->generation_num);
 	generation++;
 	mpb->generation_num = __cpu_to_le32(generation);
+	tracepoint(super_store_start, "imsm", -1, generation);
 
 	/* fix up cases where previous mdadm releases failed to set
 	 * orig_family_num
@@ -5216,27 +5879,21 @@ static int write_super_imsm(struct supertype *st, int doclose)
 		memset(super->migr_rec_buf, 0, MIGR_REC_BUF_SIZE);
 
 	/* write the mpb for disks that compose raid devices */
+	for (d = super->disks; d ; d = d->next)
+		if (d->index >= 0 && !is_failed(&d->disk))
+			members++;
+	if (members &&
+	    write_mpb_batch(super, members, clear_migration_record) != 0) {
+		tracepoint(super_store_done, "imsm", -1, -1);
+		return 1;
+	}
+	if (!members)
+		super->written_cnt = 0;
+	tracepoint(super_store_done, "imsm", -1, members);
+
 	for (d = super->disks; d ; d = d->next) {
 		if (d->index < 0 || is_failed(&d->disk))
 			continue;
-
-		if (clear_migration_record) {
-			unsigned long long dsize;
-
-			get_dev_size(d->fd, NULL, &dsize);
-			if (lseek64(d->fd, dsize - 512, SEEK_SET) >= 0) {
-				if (write(d->fd, super->migr_rec_buf,
-					MIGR_REC_BUF_SIZE) != MIGR_REC_BUF_SIZE)
-					perror("Write migr_rec failed");
-			}
-		}
-
-		if (store_imsm_mpb(d->fd, mpb))
-			fprintf(stderr,
-				"failed for device %d:%d (fd: %d)%s\n",
-				d->major, d->minor,
-				d->fd, strerror(errno));
-
 		if (doclose) {
 			close(d->fd);
 			d->fd = -1;
@@ -5338,6 +5995,8 @@ static int store_super_imsm(struct supertype *st, int fd)
 		return 1;
 
 #ifndef MDASSEMBLE
+	/* fd may be one of ours, see write_mpb_batch() */
+	super->written_cnt = 0;
 	return store_imsm_mpb(fd, mpb);
 #else
 	return 1;
@@ -7826,6 +8485,7 @@ static int remove_disk_super(struct intel_super *super, int major, int minor)
 			else
 				super->disks = dl->next;
 			dl->next = NULL;
+			imsm_drop_disk_index(super);
 			__free_imsm_disk(dl);
 			dprintf("removed %x:%x\n", major, minor);
 			break;
@@ -8395,6 +9055,7 @@ static void imsm_process_update(struct supertype *st,
 		super->next_len = 0;
 		super->next_buf = NULL;
 	}
+	imsm_use_next_write_space(super);
 
 	mpb = super->anchor;
 
@@ -8907,6 +9568,14 @@ static int imsm_prepare_update(struct supertype *st,
 		else
 			super->next_buf = NULL;
 	}
+	/* and room to write it out; without that the update is dropped
+	 * just as for a failed buffer allocation
+	 */
+	if (imsm_prepare_write_space(super, buf_len, 1)) {
+		free(super->next_buf);
+		super->next_buf = NULL;
+		super->next_len = buf_len;
+	}
 	return 1;
 }
 
@@ -8957,6 +9626,7 @@ static void imsm_delete(struct intel_super *super, struct dl **dlp, unsigned ind
 		struct dl *dl = *dlp;
 
 		*dlp = (*dlp)->next;
+		imsm_drop_disk_index(super);
 		__free_imsm_disk(dl);
 	}
 }
@@ -9272,11 +9942,6 @@ int save_backup_imsm(struct supertype *st,
 	unsigned long long start;
 	int data_disks = imsm_num_data_members(dev, MAP_0);
 
-	targets = xmalloc(new_disks * sizeof(int));
-
-	for (i = 0; i < new_disks; i++)
-		targets[i] = -1;
-
 	target_offsets = xcalloc(new_disks, sizeof(unsigned long long));
 
 	start = info->reshape_progress * 512;
@@ -9289,9 +9954,17 @@ int save_backup_imsm(struct supertype *st,
 		target_offsets[i] -= start/data_disks;
 	}
 
-	if (open_backup_targets(info, new_disks, targets,
-				super, dev))
-		goto abort;
+	if (super->reshape_io && super->reshape_io->new_disks == new_disks)
+		targets = super->reshape_io->targets;
+	else {
+		targets = xmalloc(new_disks * sizeof(int));
+		if (open_backup_targets(info, new_disks, targets,
+					super, dev)) {
+			free(targets);
+			targets = NULL;
+			goto abort;
+		}
+	}
 
 	dest_layout = imsm_level_to_layout(map_dest->raid_level);
 	dest_chunk = __le16_to_cpu(map_dest->blocks_per_strip) * 512;
@@ -9315,7 +9988,8 @@ int save_backup_imsm(struct supertype *st,
 	rv = 0;
 
 abort:
-	if (targets) {
+	if (targets && (!super->reshape_io ||
+			targets != super->reshape_io->targets)) {
 		close_targets(targets, new_disks);
 		free(targets);
 	}
@@ -9343,7 +10017,10 @@ int save_checkpoint_imsm(struct supertype *st, struct mdinfo *info, int state)
 	unsigned long long blocks_per_unit;
 	unsigned long long curr_migr_unit;
 
-	if (load_imsm_migr_rec(super, info) != 0) {
+	/* while imsm_manage_reshape() holds the devices open, the
+	 * record in memory is the one last written
+	 */
+	if (!super->reshape_io && load_imsm_migr_rec(super, info) != 0) {
 		dprintf("imsm: ERROR: Cannot read migration record for checkpoint save.\n");
 		return 1;
 	}
@@ -10362,6 +11039,123 @@ int check_degradation_change(struct mdinfo *info,
 	return new_degraded;
 }
 
+static void close_reshape_io(struct intel_super *super)
+{
+	struct imsm_reshape_io *rio = super->reshape_io;
+	int i;
+
+	if (!rio)
+		return;
+	close_targets(rio->targets, rio->new_disks);
+	free(rio->targets);
+	for (i = 0; i < rio->rec_cnt; i++)
+		close(rio->rec_fd[i]);
+	free(rio);
+	super->reshape_io = NULL;
+}
+
+/* Open the copy area targets and the (up to two) devices that hold the
+ * migration record, and remember where the record lives, so that each
+ * migration unit is only I/O.  Returns NULL if anything is missing, in
+ * which case the devices are opened per unit as before.
+ */
+static struct imsm_reshape_io *open_reshape_io(struct intel_super *super,
+					       struct imsm_dev *dev,
+					       struct mdinfo *sra)
+{
+	struct imsm_map *map = get_imsm_map(dev, MAP_0);
+	struct imsm_reshape_io *rio = xcalloc(1, sizeof(*rio));
+	struct dl *sd;
+
+	rio->new_disks = map->num_members;
+	rio->targets = xmalloc(rio->new_disks * sizeof(int));
+	if (open_backup_targets(sra, rio->new_disks, rio->targets,
+				super, dev)) {
+		free(rio->targets);
+		free(rio);
+		return NULL;
+	}
+	super->reshape_io = rio;
+
+	for (sd = super->disks; sd && rio->rec_cnt < 2; sd = sd->next) {
+		int slot;
+		unsigned long long dsize;
+		char nm[30];
+		int fd;
+
+		if (sd->index < 0)
+			continue;
+		slot = get_imsm_disk_slot(map, sd->index);
+		if (slot < 0 || slot > 1)
+			continue;
+		sprintf(nm, "%d:%d", sd->major, sd->minor);
+		fd = dev_open(nm, O_RDWR);
+		if (fd < 0)
+			continue;
+		if (!get_dev_size(fd, NULL, &dsize)) {
+			close(fd);
+			continue;
+		}
+		rio->rec_fd[rio->rec_cnt] = fd;
+		rio->rec_offset[rio->rec_cnt] = dsize - MIGR_REC_POSITION;
+		rio->rec_cnt++;
+	}
+	if (rio->rec_cnt == 0) {
+		close_reshape_io(super);
+		return NULL;
+	}
+	return rio;
+}
+
+/* With IMSM_ADAPTIVE_MIGRATION=1 in the environment, a step outside the
+ * critical section covers as many migration units as the kernel can
+ * reshape in about IMSM_ADAPT_CKPT_RATIO times the time the last
+ * checkpoint took, so that checkpoints stay a small part of the work on
+ * fast members while the suspended range stays small on slow ones.  It
+ * never covers more than 'border' allows: data written in the new
+ * layout must not reach data still to be read in the old one.  The unit
+ * size itself is left alone as the Option ROM depends on it, and so
+ * critical sections are still one unit (the size of the copy area).
+ */
+#define IMSM_ADAPT_CKPT_RATIO 20
+#define IMSM_ADAPT_MIN_STEP 0.2 /* [s] */
+#define IMSM_ADAPT_MAX_STEP 5.0 /* [s] */
+
+static double imsm_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static unsigned long long imsm_adapt_units(unsigned long long border,
+					   struct migr_record *migr_rec,
+					   double rate, double ckpt_time)
+{
+	unsigned long long max_units;
+	unsigned long long units;
+	double t = ckpt_time * IMSM_ADAPT_CKPT_RATIO;
+
+	/* border is in per-member sectors, as is the unit depth */
+	max_units = border / __le32_to_cpu(migr_rec->dest_depth_per_unit);
+	if (max_units < 1)
+		max_units = 1;
+	if (rate <= 0)
+		/* nothing measured yet */
+		return 1;
+	if (t < IMSM_ADAPT_MIN_STEP)
+		t = IMSM_ADAPT_MIN_STEP;
+	if (t > IMSM_ADAPT_MAX_STEP)
+		t = IMSM_ADAPT_MAX_STEP;
+	units = rate * t / __le32_to_cpu(migr_rec->blocks_per_unit);
+	if (units < 1)
+		units = 1;
+	if (units > max_units)
+		units = max_units;
+	return units;
+}
+
 /*******************************************************************************
  * Function:	imsm_manage_reshape
  * Description:	Function finds array under reshape and it manages reshape
@@ -10407,6 +11201,9 @@ static int imsm_manage_reshape(
 	unsigned long long start_buf_shift; /* [bytes] */
 	int degraded = 0;
 	int source_layout = 0;
+	int adaptive = check_env("IMSM_ADAPTIVE_MIGRATION");
+	double reshape_rate = 0; /* [blocks/s] */
+	double ckpt_time = 0; /* [s] */
 
 	if (!fds || !offsets || !sra)
 		goto abort;
@@ -10473,6 +11270,9 @@ static int imsm_manage_reshape(
 	max_position = sra->component_size * ndata;
 	source_layout = imsm_level_to_layout(map_src->raid_level);
 
+	if (!open_reshape_io(super, dev, sra))
+		dprintf("imsm: opening reshape devices for each unit\n");
+
 	while (__le32_to_cpu(migr_rec->curr_migr_unit) <
 	       __le32_to_cpu(migr_rec->num_migr_units)) {
 		/* current reshape position [blocks] */
@@ -10480,6 +11280,8 @@ static int imsm_manage_reshape(
 			__le32_to_cpu(migr_rec->blocks_per_unit)
 			* __le32_to_cpu(migr_rec->curr_migr_unit);
 		unsigned long long border;
+		unsigned long long step_start;
+		double t;
 
 		/* Check that array hasn't become failed.
 		 */
@@ -10545,6 +11347,11 @@ static int imsm_manage_reshape(
 				dprintf("imsm: Cannot write checkpoint to migration record (UNIT_SRC_IN_CP_AREA)\n");
 				goto abort;
 			}
+		} else if (adaptive) {
+			next_step *= imsm_adapt_units(border, migr_rec,
+						      reshape_rate, ckpt_time);
+			dprintf("imsm: adaptive step of %llu blocks\n",
+				next_step);
 		} else {
 			/* set next step to use whole border area */
 			border /= next_step;
@@ -10560,46 +11367,68 @@ static int imsm_manage_reshape(
 			next_step = max_position;
 		sysfs_set_num(sra, NULL, "suspend_lo", sra->reshape_progress);
 		sysfs_set_num(sra, NULL, "suspend_hi", next_step);
+		step_start = sra->reshape_progress;
 		sra->reshape_progress = next_step;
 
 		/* wait until reshape finish */
+		t = imsm_now();
 		if (wait_for_reshape_imsm(sra, ndata) < 0) {
 			dprintf("wait_for_reshape_imsm returned error!\n");
 			goto abort;
 		}
 		if (sigterm)
 			goto abort;
+		t = imsm_now() - t;
+		if (adaptive && t > 0) {
+			double rate = (next_step - step_start) / t;
+
+			reshape_rate = reshape_rate ?
+				(reshape_rate + rate) / 2 : rate;
+		}
 
+		t = imsm_now();
 		if (save_checkpoint_imsm(st, sra, UNIT_SRC_NORMAL) == 1) {
 			/* ignore error == 2, this can mean end of reshape here
 			 */
 			dprintf("imsm: Cannot write checkpoint to migration record (UNIT_SRC_NORMAL)\n");
 			goto abort;
 		}
+		ckpt_time = imsm_now() - t;
 
 	}
 
 	/* clear migr_rec on disks after successful migration */
 	struct dl *d;
+	struct md_io *io;
+	int n = 0;
 
 	memset(super->migr_rec_buf, 0, MIGR_REC_BUF_SIZE);
+	for (d = super->disks; d; d = d->next)
+		n++;
+	io = xcalloc(n + 1, sizeof(*io));
+	n = 0;
 	for (d = super->disks; d; d = d->next) {
 		if (d->index < 0 || is_failed(&d->disk))
 			continue;
 		unsigned long long dsize;
 
-		get_dev_size(d->fd, NULL, &dsize);
-		if (lseek64(d->fd, dsize - MIGR_REC_POSITION,
-			    SEEK_SET) >= 0) {
-			if (write(d->fd, super->migr_rec_buf,
-				MIGR_REC_BUF_SIZE) != MIGR_REC_BUF_SIZE)
-				perror("Write migr_rec failed");
-		}
+		if (!get_dev_size(d->fd, NULL, &dsize))
+			continue;
+		io[n].fd = d->fd;
+		io[n].write = 1;
+		io[n].buf = super->migr_rec_buf;
+		io[n].len = MIGR_REC_BUF_SIZE;
+		io[n].offset = dsize - MIGR_REC_POSITION;
+		n++;
 	}
+	if (n && md_io_batch(io, n))
+		pr_err("Write migr_rec failed\n");
+	free(io);
 
 	/* return '1' if done */
 	ret_val = 1;
 abort:
+	close_reshape_io(super);
 	free(buf);
 	abort_reshape(sra);
 
@@ -862,18 +862,24 @@ static int store_super0(struct supertype *st, int fd)
 	if (lseek64(fd, offset, 0)< 0LL)
 		return 3;
 
-	if (write(fd, super, sizeof(*super)) != sizeof(*super))
+	tracepoint(super_store_start, "0.90", fd, offset >> 9);
+	if (write(fd, super, sizeof(*super)) != sizeof(*super)) {
+		tracepoint(super_store_done, "0.90", fd, -4);
 		return 4;
+	}
 
 	if (super->state & (1<<MD_SB_BITMAP_PRESENT)) {
 		struct bitmap_super_s * bm = (struct bitmap_super_s*)(super+1);
 		if (__le32_to_cpu(bm->magic) == BITMAP_MAGIC)
 			if (write(fd, bm, ROUND_UP(sizeof(*bm),4096)) !=
-			    ROUND_UP(sizeof(*bm),4096))
-			    return 5;
+			    ROUND_UP(sizeof(*bm),4096)) {
+				tracepoint(super_store_done, "0.90", fd, -5);
+				return 5;
+			}
 	}
 
 	fsync(fd);
+	tracepoint(super_store_done, "0.90", fd, (int)sizeof(*super));
 	return 0;
 }
 
@@ -969,6 +975,7 @@ static int load_super0(struct supertype *st, int fd, char *devname)
 	mdp_super_t *super;
 	int uuid[4];
 	struct bitmap_super_s *bsb;
+	int n;
 
 	free_super0(st);
 
@@ -1001,7 +1008,10 @@ static int load_super0(struct supertype *st, int fd, char *devname)
 		return 1;
 	}
 
-	if (read(fd, super, sizeof(*super)) != MD_SB_BYTES) {
+	tracepoint(super_load_start, "0.90", fd, offset >> 9);
+	n = read(fd, super, sizeof(*super));
+	tracepoint(super_load_done, "0.90", fd, n);
+	if (n != MD_SB_BYTES) {
 		if (devname)
 			pr_err("Cannot read superblock on %s\n",
 				devname);
@@ -1199,22 +1209,19 @@ static int write_bitmap0(struct supertype *st, int fd)
 	if (lseek64(fd, offset + 4096, 0)< 0LL)
 		return 3;
 
-	if (posix_memalign(&buf, 4096, 4096))
+	/* The whole 60K goes in one write */
+	towrite = 60*1024;
+	if (posix_memalign(&buf, 4096, towrite))
 		return -ENOMEM;
 
-	memset(buf, 0xff, 4096);
+	memset(buf, st->bitmap_clean ? 0 : 0xff, towrite);
 	memcpy(buf,  ((char*)sb)+MD_SB_BYTES, sizeof(bitmap_super_t));
-	towrite = 60*1024;
 	while (towrite > 0) {
-		n = towrite;
-		if (n > 4096)
-			n = 4096;
-		n = write(fd, buf, n);
+		n = write(fd, (char *)buf + 60*1024 - towrite, towrite);
 		if (n > 0)
 			towrite -= n;
 		else
 			break;
-		memset(buf, 0xff, 4096);
 	}
 	fsync(fd);
 	if (towrite)
@@ -150,11 +150,9 @@ static unsigned int calc_sb_1_csum(struct mdp_superblock_1 * sb)
 
 	disk_csum = sb->sb_csum;
 	sb->sb_csum = 0;
-	newcsum = 0;
-	for (; size>=4; size -= 4 ) {
-		newcsum += __le32_to_cpu(*isuper);
-		isuper++;
-	}
+	newcsum = sum_le32(isuper, size & ~3);
+	isuper += size / 4;
+	size &= 3;
 
 	if (size == 2)
 		newcsum += __le16_to_cpu(*(unsigned short*) isuper);
@@ -563,7 +561,7 @@ static void export_examine_super1(struct supertype *st)
 			break;
 		}
 	if (len)
-		printf("MD_NAME=%.*s\n", len, sb->set_name);
+		export_value("MD_NAME", "%.*s", len, sb->set_name);
 	if (__le32_to_cpu(sb->level) > 0) {
 		int ddsks = 0, ddsks_denom = 1;
 		switch(__le32_to_cpu(sb->level)) {
@@ -716,7 +714,25 @@ static int copy_metadata1(struct supertype *st, int from, int to)
 		if (lseek64(to, bb_offset<<9, 0) < 0)
 			goto err;
 
-		for (written = 0; written < bytes ; ) {
+		if (bytes % afrom.blk_sz == 0 && bytes % ato.blk_sz == 0 &&
+		    (bb_offset << 9) % afrom.blk_sz == 0 &&
+		    (bb_offset << 9) % ato.blk_sz == 0) {
+			/* The log is at most 50K and suitably aligned for
+			 * O_DIRECT on both devices, so copy it in one go.
+			 */
+			void *bbl;
+
+			if (posix_memalign(&bbl, 4096, bytes) != 0)
+				goto err;
+			if (read(from, bbl, bytes) != bytes ||
+			    write(to, bbl, bytes) != bytes) {
+				free(bbl);
+				goto err;
+			}
+			free(bbl);
+			written = bytes;
+		}
+		for (; written < bytes ; ) {
 			int n = bytes - written;
 			if (n > 4096)
 				n = 4096;
@@ -785,62 +801,62 @@ static void export_detail_super1(struct supertype *st)
 			break;
 		}
 	if (len)
-		printf("MD_NAME=%.*s\n", len, sb->set_name);
+		export_value("MD_NAME", "%.*s", len, sb->set_name);
 }
 
-static int examine_badblocks_super1(struct supertype *st, int fd, char *devname)
+/* Decode the bad-block log into 'bb' with a single read.
+ * Returns 0 on success, 2 if there is no log and 1 on error.
+ */
+static int get_bad_blocks_super1(struct supertype *st, int fd,
+				 struct md_bb *bb)
 {
 	struct mdp_superblock_1 *sb = st->sb;
 	unsigned long long offset;
 	int size;
-	__u64 *bbl, *bbp;
+	__u64 *bbl;
 	int i;
 
 	if  (!sb->bblog_size || __le32_to_cpu(sb->bblog_size) > 100
-	     || !sb->bblog_offset){
-		printf("No bad-blocks list configured on %s\n", devname);
-		return 0;
-	}
+	     || !sb->bblog_offset)
+		return 2;
 	if ((sb->feature_map & __cpu_to_le32(MD_FEATURE_BAD_BLOCKS))
-	    == 0) {
-		printf("Bad-blocks list is empty in %s\n", devname);
+	    == 0)
 		return 0;
-	}
 
 	size = __le32_to_cpu(sb->bblog_size)* 512;
 	if (posix_memalign((void**)&bbl, 4096, size) != 0) {
 		pr_err("could not allocate badblocks list\n");
-		return 0;
+		return 1;
 	}
 	offset = __le64_to_cpu(sb->super_offset) +
 		(int)__le32_to_cpu(sb->bblog_offset);
 	offset <<= 9;
 	if (lseek64(fd, offset, 0) < 0) {
 		pr_err("Cannot seek to bad-blocks list\n");
+		free(bbl);
 		return 1;
 	}
 	if (read(fd, bbl, size) != size) {
 		pr_err("Cannot read bad-blocks list\n");
+		free(bbl);
 		return 1;
 	}
 	/* 64bits per entry. 10 bits is block-count, 54 bits is block
 	 * offset.  Blocks are sectors unless bblog->shift makes them bigger
 	 */
-	bbp = (__u64*)bbl;
-	printf("Bad-blocks on %s:\n", devname);
-	for (i = 0; i < size/8; i++, bbp++) {
-		__u64 bb = __le64_to_cpu(*bbp);
-		int count = bb & 0x3ff;
-		unsigned long long sector = bb >> 10;
-
-		if (bb + 1 == 0)
-			break;
+	for (i = 0; i < size/8; i++) {
+		__u64 bb64 = __le64_to_cpu(bbl[i]);
+		unsigned long long count = bb64 & 0x3ff;
+		unsigned long long sector = bb64 >> 10;
 
-		sector <<= sb->bblog_shift;
-		count <<= sb->bblog_shift;
+		if (bb64 + 1 == 0)
+			break;
 
-		printf("%20llu for %d sectors\n", sector, count);
+		md_bb_add(bb, sector << sb->bblog_shift,
+			  count << sb->bblog_shift);
 	}
+	free(bbl);
+	md_bb_normalise(bb);
 	return 0;
 }
 
@@ -1502,19 +1518,25 @@ static int store_super1(struct supertype *st, int fd)
 
 	sbsize = ROUND_UP(sizeof(*sb) + 2 * __le32_to_cpu(sb->max_dev), 512);
 
-	if (awrite(&afd, sb, sbsize) != sbsize)
+	tracepoint(super_store_start, "1.x", fd, sb_offset);
+	if (awrite(&afd, sb, sbsize) != sbsize) {
+		tracepoint(super_store_done, "1.x", fd, -4);
 		return 4;
+	}
 
 	if (sb->feature_map & __cpu_to_le32(MD_FEATURE_BITMAP_OFFSET)) {
 		struct bitmap_super_s *bm = (struct bitmap_super_s*)
 			(((char*)sb)+MAX_SB_SIZE);
 		if (__le32_to_cpu(bm->magic) == BITMAP_MAGIC) {
 			locate_bitmap1(st, fd);
-			if (awrite(&afd, bm, sizeof(*bm)) != sizeof(*bm))
+			if (awrite(&afd, bm, sizeof(*bm)) != sizeof(*bm)) {
+				tracepoint(super_store_done, "1.x", fd, -5);
 				return 5;
+			}
 		}
 	}
 	fsync(fd);
+	tracepoint(super_store_done, "1.x", fd, sbsize);
 	return 0;
 }
 
@@ -1538,168 +1560,222 @@ static unsigned long choose_bm_space(unsigned long devsize)
 static void free_super1(struct supertype *st);
 
 #ifndef MDASSEMBLE
-static int write_init_super1(struct supertype *st)
+/* Write the superblock, and bitmap if any, to one new member.
+ * st->sb already holds a random device_uuid for it.
+ */
+static int write_init_super1_dev(struct supertype *st, struct devinfo *di)
 {
 	struct mdp_superblock_1 *sb = st->sb;
 	struct supertype *refst;
-	int rfd;
 	int rv = 0;
 	unsigned long long bm_space;
-	struct devinfo *di;
 	unsigned long long dsize, array_size;
 	unsigned long long sb_offset;
 	unsigned long long data_offset;
 
-	for (di = st->info; di; di = di->next) {
-		if (di->disk.state & (1 << MD_DISK_FAULTY))
-			continue;
-		if (di->fd < 0)
-			continue;
+	while (Kill(di->devname, NULL, 0, -1, 1) == 0)
+		;
 
-		while (Kill(di->devname, NULL, 0, -1, 1) == 0)
-			;
+	sb->dev_number = __cpu_to_le32(di->disk.number);
+	if (di->disk.state & (1<<MD_DISK_WRITEMOSTLY))
+		sb->devflags |= WriteMostly1;
+	else
+		sb->devflags &= ~WriteMostly1;
 
-		sb->dev_number = __cpu_to_le32(di->disk.number);
-		if (di->disk.state & (1<<MD_DISK_WRITEMOSTLY))
-			sb->devflags |= WriteMostly1;
-		else
-			sb->devflags &= ~WriteMostly1;
+	sb->events = 0;
 
-		if ((rfd = open("/dev/urandom", O_RDONLY)) < 0 ||
-		    read(rfd, sb->device_uuid, 16) != 16) {
-			__u32 r[4] = {random(), random(), random(), random()};
-			memcpy(sb->device_uuid, r, 16);
+	refst = dup_super(st);
+	if (load_super1(refst, di->fd, NULL)==0) {
+		struct mdp_superblock_1 *refsb = refst->sb;
+
+		memcpy(sb->device_uuid, refsb->device_uuid, 16);
+		if (memcmp(sb->set_uuid, refsb->set_uuid, 16)==0) {
+			/* same array, so preserve events and
+			 * dev_number */
+			sb->events = refsb->events;
+			/* bugs in 2.6.17 and earlier mean the
+			 * dev_number chosen in Manage must be preserved
+			 */
+			if (get_linux_version() >= 2006018)
+				sb->dev_number = refsb->dev_number;
 		}
-		if (rfd >= 0)
-			close(rfd);
+		free_super1(refst);
+	}
+	free(refst);
 
-		sb->events = 0;
+	if (!get_dev_size(di->fd, NULL, &dsize))
+		return 1;
+	dsize >>= 9;
 
-		refst = dup_super(st);
-		if (load_super1(refst, di->fd, NULL)==0) {
-			struct mdp_superblock_1 *refsb = refst->sb;
+	if (dsize < 24)
+		return 2;
 
-			memcpy(sb->device_uuid, refsb->device_uuid, 16);
-			if (memcmp(sb->set_uuid, refsb->set_uuid, 16)==0) {
-				/* same array, so preserve events and
-				 * dev_number */
-				sb->events = refsb->events;
-				/* bugs in 2.6.17 and earlier mean the
-				 * dev_number chosen in Manage must be preserved
-				 */
-				if (get_linux_version() >= 2006018)
-					sb->dev_number = refsb->dev_number;
-			}
-			free_super1(refst);
-		}
-		free(refst);
+	/*
+	 * Calculate the position of the superblock.
+	 * It is always aligned to a 4K boundary and
+	 * depending on minor_version, it can be:
+	 * 0: At least 8K, but less than 12K, from end of device
+	 * 1: At start of device
+	 * 2: 4K from start of device.
+	 * data_offset has already been set.
+	 */
+	array_size = __le64_to_cpu(sb->size);
+	/* work out how much space we left for a bitmap,
+	 * Add 8 sectors for bad block log */
+	bm_space = choose_bm_space(array_size) + 8;
 
-		if (!get_dev_size(di->fd, NULL, &dsize)) {
-			rv = 1;
-			goto error_out;
+	data_offset = di->data_offset;
+	if (data_offset == INVALID_SECTORS)
+		data_offset = st->data_offset;
+	switch(st->minor_version) {
+	case 0:
+		if (data_offset == INVALID_SECTORS)
+			data_offset = 0;
+		sb_offset = dsize;
+		sb_offset -= 8*2;
+		sb_offset &= ~(4*2-1);
+		sb->data_offset = __cpu_to_le64(data_offset);
+		sb->super_offset = __cpu_to_le64(sb_offset);
+		if (sb_offset < array_size + bm_space)
+			bm_space = sb_offset - array_size;
+		sb->data_size = __cpu_to_le64(sb_offset - bm_space);
+		if (bm_space >= 8) {
+			sb->bblog_size = __cpu_to_le16(8);
+			sb->bblog_offset = __cpu_to_le32((unsigned)-8);
 		}
-		dsize >>= 9;
-
-		if (dsize < 24) {
-			close(di->fd);
-			rv = 2;
-			goto error_out;
+		break;
+	case 1:
+		sb->super_offset = __cpu_to_le64(0);
+		if (data_offset == INVALID_SECTORS)
+			data_offset = 16;
+
+		sb->data_offset = __cpu_to_le64(data_offset);
+		sb->data_size = __cpu_to_le64(dsize - data_offset);
+		if (data_offset >= 8 + 32*2 + 8) {
+			sb->bblog_size = __cpu_to_le16(8);
+			sb->bblog_offset = __cpu_to_le32(8 + 32*2);
+		} else if (data_offset >= 16) {
+			sb->bblog_size = __cpu_to_le16(8);
+			sb->bblog_offset = __cpu_to_le32(data_offset-8);
+		}
+		break;
+	case 2:
+		sb_offset = 4*2;
+		sb->super_offset = __cpu_to_le64(sb_offset);
+		if (data_offset == INVALID_SECTORS)
+			data_offset = 24;
+
+		sb->data_offset = __cpu_to_le64(data_offset);
+		sb->data_size = __cpu_to_le64(dsize - data_offset);
+		if (data_offset >= 16 + 32*2 + 8) {
+			sb->bblog_size = __cpu_to_le16(8);
+			sb->bblog_offset = __cpu_to_le32(8 + 32*2);
+		} else if (data_offset >= 16+16) {
+			sb->bblog_size = __cpu_to_le16(8);
+			/* '8' sectors for the bblog, and another '8'
+			 * because we want offset from superblock, not
+			 * start of device.
+			 */
+			sb->bblog_offset = __cpu_to_le32(data_offset-8-8);
 		}
+		break;
+	}
+	if (conf_get_create_info()->bblist == 0) {
+		sb->bblog_size = 0;
+		sb->bblog_offset = 0;
+	}
 
-		/*
-		 * Calculate the position of the superblock.
-		 * It is always aligned to a 4K boundary and
-		 * depending on minor_version, it can be:
-		 * 0: At least 8K, but less than 12K, from end of device
-		 * 1: At start of device
-		 * 2: 4K from start of device.
-		 * data_offset has already been set.
-		 */
-		array_size = __le64_to_cpu(sb->size);
-		/* work out how much space we left for a bitmap,
-		 * Add 8 sectors for bad block log */
-		bm_space = choose_bm_space(array_size) + 8;
+	sb->sb_csum = calc_sb_1_csum(sb);
+	rv = store_super1(st, di->fd);
+	if (rv == 0 && (__le32_to_cpu(sb->feature_map) & 1))
+		rv = st->ss->write_bitmap(st, di->fd);
+	return rv;
+}
 
-		data_offset = di->data_offset;
-		if (data_offset == INVALID_SECTORS)
-			data_offset = st->data_offset;
-		switch(st->minor_version) {
-		case 0:
-			if (data_offset == INVALID_SECTORS)
-				data_offset = 0;
-			sb_offset = dsize;
-			sb_offset -= 8*2;
-			sb_offset &= ~(4*2-1);
-			sb->data_offset = __cpu_to_le64(data_offset);
-			sb->super_offset = __cpu_to_le64(sb_offset);
-			if (sb_offset < array_size + bm_space)
-				bm_space = sb_offset - array_size;
-			sb->data_size = __cpu_to_le64(sb_offset - bm_space);
-			if (bm_space >= 8) {
-				sb->bblog_size = __cpu_to_le16(8);
-				sb->bblog_offset = __cpu_to_le32((unsigned)-8);
-			}
-			break;
-		case 1:
-			sb->super_offset = __cpu_to_le64(0);
-			if (data_offset == INVALID_SECTORS)
-				data_offset = 16;
+/*
+ * With many members most of the time goes in waiting for each
+ * superblock and bitmap to be written and synced, so when there is
+ * more than one member each is written by a child process, with at
+ * most WRITE_INIT_JOBS at once.  Each child works on its own copy of
+ * the superblock.  Failures are reported after all have finished, in
+ * device order, so the messages do not depend on timing.
+ */
+#define WRITE_INIT_JOBS 16
 
-			sb->data_offset = __cpu_to_le64(data_offset);
-			sb->data_size = __cpu_to_le64(dsize - data_offset);
-			if (data_offset >= 8 + 32*2 + 8) {
-				sb->bblog_size = __cpu_to_le16(8);
-				sb->bblog_offset = __cpu_to_le32(8 + 32*2);
-			} else if (data_offset >= 16) {
-				sb->bblog_size = __cpu_to_le16(8);
-				sb->bblog_offset = __cpu_to_le32(data_offset-8);
-			}
-			break;
-		case 2:
-			sb_offset = 4*2;
-			sb->super_offset = __cpu_to_le64(sb_offset);
-			if (data_offset == INVALID_SECTORS)
-				data_offset = 24;
-
-			sb->data_offset = __cpu_to_le64(data_offset);
-			sb->data_size = __cpu_to_le64(dsize - data_offset);
-			if (data_offset >= 16 + 32*2 + 8) {
-				sb->bblog_size = __cpu_to_le16(8);
-				sb->bblog_offset = __cpu_to_le32(8 + 32*2);
-			} else if (data_offset >= 16+16) {
-				sb->bblog_size = __cpu_to_le16(8);
-				/* '8' sectors for the bblog, and another '8'
-				 * because we want offset from superblock, not
-				 * start of device.
-				 */
-				sb->bblog_offset = __cpu_to_le32(data_offset-8-8);
-			}
-			break;
-		default:
-			pr_err("Failed to write invalid metadata format 1.%i to %s\n",
-			       st->minor_version, di->devname);
-			rv = -EINVAL;
-			goto out;
-		}
-		if (conf_get_create_info()->bblist == 0) {
-			sb->bblog_size = 0;
-			sb->bblog_offset = 0;
+struct write_init_jobs {
+	struct supertype *st;
+	struct devinfo **di;
+	unsigned char (*uuid)[16];
+};
+
+static int write_init_super1_job(void *arg, int i)
+{
+	struct write_init_jobs *jobs = arg;
+	struct mdp_superblock_1 *sb = jobs->st->sb;
+
+	memcpy(sb->device_uuid, jobs->uuid[i], 16);
+	return write_init_super1_dev(jobs->st, jobs->di[i]);
+}
+
+static int write_init_super1(struct supertype *st)
+{
+	struct write_init_jobs jobs;
+	int *rvs;
+	int rfd;
+	int rv = 0;
+	struct devinfo *di;
+	int cnt = 0;
+	int i;
+
+	if (st->minor_version < 0 || st->minor_version > 2) {
+		pr_err("Failed to write invalid metadata format 1.%i\n",
+		       st->minor_version);
+		return -EINVAL;
+	}
+
+	for (di = st->info; di; di = di->next)
+		if (!(di->disk.state & (1 << MD_DISK_FAULTY)) && di->fd >= 0)
+			cnt++;
+	jobs.st = st;
+	jobs.di = xcalloc(cnt ? cnt : 1, sizeof(jobs.di[0]));
+	jobs.uuid = xcalloc(cnt ? cnt : 1, sizeof(jobs.uuid[0]));
+	rvs = xcalloc(cnt ? cnt : 1, sizeof(rvs[0]));
+
+	/* Choose the device uuids here, as children would all
+	 * get the same values from random().
+	 */
+	rfd = open("/dev/urandom", O_RDONLY);
+	for (i = 0, di = st->info; di; di = di->next) {
+		if (di->disk.state & (1 << MD_DISK_FAULTY))
+			continue;
+		if (di->fd < 0)
+			continue;
+		if (rfd < 0 ||
+		    read(rfd, jobs.uuid[i], 16) != 16) {
+			__u32 r[4] = {random(), random(), random(), random()};
+			memcpy(jobs.uuid[i], r, 16);
 		}
+		jobs.di[i++] = di;
+	}
+	if (rfd >= 0)
+		close(rfd);
+
+	run_jobs(cnt, WRITE_INIT_JOBS, write_init_super1_job, &jobs, rvs);
 
-		sb->sb_csum = calc_sb_1_csum(sb);
-		rv = store_super1(st, di->fd);
-		if (rv == 0 && (__le32_to_cpu(sb->feature_map) & 1))
-			rv = st->ss->write_bitmap(st, di->fd);
+	for (i = 0; i < cnt; i++) {
+		di = jobs.di[i];
 		close(di->fd);
 		di->fd = -1;
-		if (rv)
-			goto error_out;
-	}
-error_out:
-	if (rv)
-		pr_err("Failed to write metadata to %s\n",
-		       di->devname);
-out:
+		if (rvs[i]) {
+			pr_err("Failed to write metadata to %s\n",
+			       di->devname);
+			if (!rv)
+				rv = rvs[i];
+		}
+	}
+	free(jobs.di);
+	free(jobs.uuid);
+	free(rvs);
 	return rv;
 }
 #endif
@@ -1752,6 +1828,7 @@ static int load_super1(struct supertype *st, int fd, char *devname)
 	struct bitmap_super_s *bsb;
 	struct misc_dev_info *misc;
 	struct align_fd afd;
+	int n;
 
 	free_super1(st);
 
@@ -1838,7 +1915,10 @@ static int load_super1(struct supertype *st, int fd, char *devname)
 		return 1;
 	}
 
-	if (aread(&afd, super, MAX_SB_SIZE) != MAX_SB_SIZE) {
+	tracepoint(super_load_start, "1.x", fd, sb_offset);
+	n = aread(&afd, super, MAX_SB_SIZE);
+	tracepoint(super_load_done, "1.x", fd, n);
+	if (n != MAX_SB_SIZE) {
 		if (devname)
 			pr_err("Cannot read superblock on %s\n",
 				devname);
@@ -2169,39 +2249,53 @@ static void locate_bitmap1(struct supertype *st, int fd)
 	lseek64(fd, offset<<9, 0);
 }
 
+/* The bitmap is written in pieces of up to this size */
+#define BITMAP_WRITE_MAX (1024*1024)
+
 static int write_bitmap1(struct supertype *st, int fd)
 {
 	struct mdp_superblock_1 *sb = st->sb;
 	bitmap_super_t *bms = (bitmap_super_t*)(((char*)sb)+MAX_SB_SIZE);
 	int rv = 0;
 	void *buf;
-	int towrite, n;
+	int towrite, n, bufsize;
 	struct align_fd afd;
+	int fill = st->bitmap_clean ? 0 : 0xff;
 
 	init_afd(&afd, fd);
 
 	locate_bitmap1(st, fd);
 
-	if (posix_memalign(&buf, 4096, 4096))
-		return -ENOMEM;
-
-	memset(buf, 0xff, 4096);
-	memcpy(buf, (char *)bms, sizeof(bitmap_super_t));
-
 	towrite = __le64_to_cpu(bms->sync_size) / (__le32_to_cpu(bms->chunksize)>>9);
 	towrite = (towrite+7) >> 3; /* bits to bytes */
 	towrite += sizeof(bitmap_super_t);
 	towrite = ROUND_UP(towrite, 512);
+
+	bufsize = ROUND_UP(towrite, 4096);
+	if (bufsize > BITMAP_WRITE_MAX)
+		bufsize = BITMAP_WRITE_MAX;
+	if (posix_memalign(&buf, 4096, bufsize))
+		return -ENOMEM;
+
+	memset(buf, fill, bufsize);
+	memcpy(buf, (char *)bms, sizeof(bitmap_super_t));
+
 	while (towrite > 0) {
 		n = towrite;
-		if (n > 4096)
-			n = 4096;
-		n = awrite(&afd, buf, n);
+		if (n > bufsize)
+			n = bufsize;
+		/* Whole sectors go straight from the aligned buffer;
+		 * awrite() handles a final partial sector.
+		 */
+		if (afd.blk_sz > 0 && n >= afd.blk_sz)
+			n = write(fd, buf, n - n % afd.blk_sz);
+		else
+			n = awrite(&afd, buf, n);
 		if (n > 0)
 			towrite -= n;
 		else
 			break;
-		memset(buf, 0xff, 4096);
+		memset(buf, fill, sizeof(bitmap_super_t));
 	}
 	fsync(fd);
 	if (towrite)
@@ -2390,7 +2484,7 @@ struct superswitch super1 = {
 	.write_init_super = write_init_super1,
 	.validate_geometry = validate_geometry1,
 	.add_to_super = add_to_super1,
-	.examine_badblocks = examine_badblocks_super1,
+	.get_bad_blocks = get_bad_blocks_super1,
 	.copy_metadata = copy_metadata1,
 #endif
 	.match_home = match_home1,
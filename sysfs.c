@@ -33,8 +33,10 @@ int load_sys(char *path, char *buf)
 	int n;
 	if (fd < 0)
 		return -1;
+	tracepoint(sysfs_load_start, path);
 	n = read(fd, buf, 1024);
 	close(fd);
+	tracepoint(sysfs_load_done, path, n);
 	if (n <0 || n >= 1024)
 		return -1;
 	buf[n] = 0;
@@ -105,6 +107,7 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 		free(sra);
 		return NULL;
 	}
+	tracepoint(sysfs_read_start, sra->sys_name, options);
 
 	sprintf(fname, "/sys/block/%s/md/", sra->sys_name);
 	base = fname + strlen(fname);
@@ -224,8 +227,10 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 			goto abort;
 	}
 
-	if (! (options & GET_DEVS))
+	if (! (options & GET_DEVS)) {
+		tracepoint(sysfs_read_done, sra->sys_name, 0);
 		return sra;
+	}
 
 	/* Get all the devices as well */
 	*base = 0;
@@ -334,11 +339,13 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 		}
 	}
 	closedir(dir);
+	tracepoint(sysfs_read_done, sra->sys_name, 0);
 	return sra;
 
  abort:
 	if (dir)
 		closedir(dir);
+	tracepoint(sysfs_read_done, sra->sys_name, -1);
 	sysfs_free(sra);
 	return NULL;
 }
@@ -410,8 +417,10 @@ int sysfs_set_str(struct mdinfo *sra, struct mdinfo *dev,
 	fd = open(fname, O_WRONLY);
 	if (fd < 0)
 		return -1;
+	tracepoint(sysfs_write_start, fname, val);
 	n = write(fd, val, strlen(val));
 	close(fd);
+	tracepoint(sysfs_write_done, fname, (int)n);
 	if (n != strlen(val)) {
 		dprintf("failed to write '%s' to '%s' (%s)\n",
 			val, fname, strerror(errno));
@@ -490,6 +499,7 @@ int sysfs_fd_get_ll(int fd, unsigned long long *val)
 
 	lseek(fd, 0, 0);
 	n = read(fd, buf, sizeof(buf));
+	tracepoint(sysfs_fd_read, fd, n);
 	if (n <= 0)
 		return -2;
 	buf[n] = 0;
@@ -526,6 +536,7 @@ int sysfs_fd_get_two(int fd, unsigned long long *v1, unsigned long long *v2)
 
 	lseek(fd, 0, 0);
 	n = read(fd, buf, sizeof(buf));
+	tracepoint(sysfs_fd_read, fd, n);
 	if (n <= 0)
 		return -2;
 	buf[n] = 0;
@@ -562,6 +573,7 @@ int sysfs_fd_get_str(int fd, char *val, int size)
 
 	lseek(fd, 0, 0);
 	n = read(fd, val, size);
+	tracepoint(sysfs_fd_read, fd, n);
 	if (n <= 0)
 		return -1;
 	val[n] = 0;
@@ -31,6 +31,8 @@
 #include	<sys/resource.h>
 #include	<sys/vfs.h>
 #include	<linux/magic.h>
+#include	<linux/aio_abi.h>
+#include	<sys/syscall.h>
 #include	<ctype.h>
 #include	<dirent.h>
 #include	<signal.h>
@@ -1159,6 +1161,193 @@ struct supertype *guess_super_type(int fd, enum guess_types guess_type)
 	return NULL;
 }
 
+/* Sum 'len' bytes (a multiple of 4) of little-endian 32bit words,
+ * as used by the 1.x and IMSM metadata checksums.  Four independent
+ * accumulators avoid a serial dependency and let the compiler use
+ * vector adds.
+ */
+unsigned long long sum_le32(const void *buf, int len)
+{
+	const __u32 *p = buf;
+	unsigned long long s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int n = len / 4;
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		s0 += __le32_to_cpu(p[i]);
+		s1 += __le32_to_cpu(p[i+1]);
+		s2 += __le32_to_cpu(p[i+2]);
+		s3 += __le32_to_cpu(p[i+3]);
+	}
+	for (; i < n; i++)
+		s0 += __le32_to_cpu(p[i]);
+	return s0 + s1 + s2 + s3;
+}
+
+/* Submit a batch of metadata writes (or reads) to several devices at
+ * once using the kernel's native AIO, so that the devices work in
+ * parallel, and wait for them all.  If AIO is not available each I/O
+ * is done in turn.  io[i].rv is set to the byte count or -errno, and
+ * the number of I/Os which did not transfer everything is returned.
+ * Each thread gets its own AIO context, created on first use, as the
+ * monitor and manager threads of mdmon both write metadata.
+ */
+#define MD_IO_BATCH 64
+int md_io_batch(struct md_io *io, int cnt)
+{
+	static __thread aio_context_t ctx;
+	static __thread int ctx_state; /* 0 untried, 1 ready, -1 failed */
+	struct iocb cbs[MD_IO_BATCH], *cbp[MD_IO_BATCH];
+	struct io_event ev[MD_IO_BATCH];
+	int failed = 0;
+	int i, n;
+
+	if (ctx_state == 0)
+		ctx_state = syscall(__NR_io_setup, MD_IO_BATCH, &ctx) == 0
+			? 1 : -1;
+
+	for (i = 0; i < cnt; i += n) {
+		int done = 0, j;
+
+		n = cnt - i;
+		if (n > MD_IO_BATCH)
+			n = MD_IO_BATCH;
+		if (ctx_state > 0) {
+			memset(cbs, 0, n * sizeof(cbs[0]));
+			for (j = 0; j < n; j++) {
+				struct md_io *o = &io[i+j];
+
+				cbs[j].aio_data = i + j;
+				cbs[j].aio_lio_opcode = o->write ?
+					IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+				cbs[j].aio_fildes = o->fd;
+				cbs[j].aio_buf = (unsigned long)o->buf;
+				cbs[j].aio_nbytes = o->len;
+				cbs[j].aio_offset = o->offset;
+				cbp[j] = &cbs[j];
+				o->rv = -EIO;
+			}
+			done = syscall(__NR_io_submit, ctx, n, cbp);
+			if (done < 0)
+				done = 0;
+			for (j = 0; j < done; ) {
+				int k, got;
+
+				got = syscall(__NR_io_getevents, ctx, done - j,
+					      done - j, ev, NULL);
+				if (got < 0) {
+					if (errno == EINTR)
+						continue;
+					/* Cannot happen, but the I/O must not
+					 * outlive cbs[] or the buffers.
+					 * io_destroy() waits for it, and the
+					 * rest are left as -EIO.
+					 */
+					syscall(__NR_io_destroy, ctx);
+					ctx_state = 0;
+					break;
+				}
+				for (k = 0; k < got; k++)
+					io[ev[k].data].rv = ev[k].res;
+				j += got;
+			}
+		}
+		/* anything not submitted is done synchronously */
+		for (j = done; j < n; j++) {
+			struct md_io *o = &io[i+j];
+
+			if (o->write)
+				o->rv = pwrite(o->fd, o->buf, o->len, o->offset);
+			else
+				o->rv = pread(o->fd, o->buf, o->len, o->offset);
+			if (o->rv < 0)
+				o->rv = -errno;
+		}
+		for (j = 0; j < n; j++)
+			if (io[i+j].rv != (long long)io[i+j].len)
+				failed++;
+	}
+	return failed;
+}
+
+/* Wait for one child started by run_jobs() and record its result.
+ * Only the pids we started are waited for, so other children of the
+ * caller are left alone.  Any job that has already finished is
+ * reaped first; otherwise we block on the oldest one still running.
+ * Returns 0 if there was nothing to wait for.
+ */
+static int reap_job(pid_t *pids, int cnt, int *rv)
+{
+	int status;
+	pid_t pid;
+	int first = -1;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		if (pids[i] <= 0)
+			continue;
+		if (first < 0)
+			first = i;
+		pid = waitpid(pids[i], &status, WNOHANG);
+		if (pid == pids[i])
+			goto found;
+	}
+	if (first < 0)
+		return 0;
+	i = first;
+	do
+		pid = waitpid(pids[i], &status, 0);
+	while (pid < 0 && errno == EINTR);
+	if (pid < 0) {
+		/* not ours to wait for after all */
+		pids[i] = 0;
+		rv[i] = 1;
+		return 1;
+	}
+found:
+	pids[i] = 0;
+	rv[i] = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+	return 1;
+}
+
+/* Call fn(arg, i) for each i below cnt, each in a child process of
+ * its own with at most 'max' running at once, and wait for them all.
+ * rv[i] is set to 0 if fn returned 0 and to 1 otherwise (including
+ * a child that was killed or failed to exit cleanly), so only
+ * success or failure is reported, not fn's actual value.  fn() must only affect devices, not this process, and report
+ * through stderr.  With one job, or if fork() fails, fn() is called
+ * directly.
+ */
+void run_jobs(int cnt, int max, int (*fn)(void *arg, int i), void *arg,
+	      int *rv)
+{
+	pid_t *pids;
+	int running = 0;
+	int i;
+
+	pids = xcalloc(cnt ? cnt : 1, sizeof(*pids));
+	for (i = 0; i < cnt; i++) {
+		if (cnt > 1) {
+			while (running >= max && reap_job(pids, cnt, rv))
+				running--;
+			fflush(stdout);
+			pids[i] = fork();
+			if (pids[i] == 0)
+				_exit(fn(arg, i) ? 1 : 0);
+		}
+		if (pids[i] > 0)
+			running++;
+		else {
+			/* one job, or fork failed */
+			pids[i] = 0;
+			rv[i] = fn(arg, i) ? 1 : 0;
+		}
+	}
+	while (running > 0 && reap_job(pids, cnt, rv))
+		running--;
+	free(pids);
+}
+
 /* Return size of device in bytes */
 int get_dev_size(int fd, char *dname, unsigned long long *sizep)
 {